@@ -0,0 +1,246 @@
+/*
+ * nancealoid-bench
+ *
+ * measures what a sample of run_tract() costs
+ * over a matrix of sample rates, tract lengths and features
+ * prints csv so results can be compared between releases
+ *
+ * or with -c checks every engine still sounds like the reference (see verify.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "tract.h"
+#include "voice.h"
+#include "rtlog.h"
+#include "scatter.h"
+#include "fixed.h"
+#include "verify.h"
+
+// how much audio to render for each configuration (seconds)
+#define DEFAULT_BENCH_SECONDS 1.0
+
+// how much to render before starting the clock (seconds)
+#define WARMUP_SECONDS 0.1
+
+// frames per call to the tract, like a jack period
+#define BENCH_BLOCK 256
+
+// pitch and level of the sawtooth used as the glottal source
+#define SOURCE_PITCH 110
+#define SOURCE_LEVEL 0.3
+
+// the configurations to try
+int rates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+double lengths[] = { CONTROLLER_TRACT_LENGTH_MIN, 12, 16, TRACT_LENGTH, 20, CONTROLLER_TRACT_LENGTH_MAX };
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof(*(a)))
+
+// keeps the compiler from throwing the output away
+volatile sample_t sink;
+
+// the tract being measured
+struct Tract tract;
+
+// or the choir
+struct Choir choir;
+
+double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// the different ways of running the tract
+// run_tract() once per sample, or run_tract_block() with a particular scatter kernel
+// or a whole choir of voices one by one or interleaved
+struct Engine {
+    char name[32];
+    const struct ScatterKernel *kernel; // NULL = run_tract()
+    int generic; // never use the fixed length kernels (to see what they save)
+    int nvoices; // 0 = just the one tract
+    int interleave;
+};
+
+// render some frames of sawtooth through the tract
+void render(const struct Engine *engine, sample_t *source, long nsource, long frames) {
+    sample_t in[BENCH_BLOCK];
+    sample_t out[BENCH_BLOCK];
+    long pos = 0;
+    for(long done = 0; done < frames; done += BENCH_BLOCK) {
+        long n = frames - done < BENCH_BLOCK ? frames - done : BENCH_BLOCK;
+        for(long i = 0; i < n; i++) {
+            in[i] = source[pos];
+            if(++pos == nsource)
+                pos = 0;
+        }
+        if(engine->nvoices) {
+            run_choir(&choir, in, out, n);
+        } else if(engine->kernel) {
+            run_tract_block(&tract, in, out, n);
+        } else {
+            for(long i = 0; i < n; i++)
+                out[i] = run_tract(&tract, in[i]);
+        }
+        sink = out[n - 1];
+    }
+}
+
+void setup_bench_tract(struct Tract *t, int with_frication, int with_interpolation) {
+    t->frication = with_frication ? FRICATION : 0;
+    t->interpolation = with_interpolation;
+
+    // head toward a vowel so the shape keeps changing the whole time
+    t->ambient_phoneme = PHONEME_A;
+}
+
+// benchmark a single configuration and print a line of csv
+void bench(FILE *csv, const struct Engine *engine, int sample_rate, double length, int with_frication, int with_interpolation, double seconds) {
+    // one period of the sawtooth
+    long nsource = sample_rate / SOURCE_PITCH;
+    sample_t *source = malloc(sizeof(sample_t) * nsource);
+    for(long i = 0; i < nsource; i++)
+        source[i] = ((double)i / nsource * 2 - 1) * SOURCE_LEVEL;
+
+    // setup_tract() seeds the frication noise the same every run
+    // and picks the fixed length kernels (if its allowed) to go with the scatter kernel
+    fixed_kernels = !engine->generic;
+    if(engine->nvoices) {
+        scatter_kernel = engine->kernel;
+        init_choir(&choir, engine->nvoices, sample_rate, length);
+        choir.interleave = engine->interleave;
+        // hold down a note for every voice
+        for(int v = 0; v < engine->nvoices; v++) {
+            uint8_t note_on[] = { 0x90, 0x30 + v, 0x7f };
+            choir_midi(&choir, note_on, sizeof(note_on));
+            setup_bench_tract(&choir.voices[v].tract, with_frication, with_interpolation);
+        }
+    } else {
+        if(engine->kernel)
+            scatter_kernel = engine->kernel;
+        setup_tract(&tract, sample_rate);
+        if(length != TRACT_LENGTH)
+            resize_tract(&tract, length);
+        setup_bench_tract(&tract, with_frication, with_interpolation);
+    }
+
+    render(engine, source, nsource, WARMUP_SECONDS * sample_rate);
+
+    long frames = seconds * sample_rate;
+    double start = now();
+    render(engine, source, nsource, frames);
+    double elapsed = now() - start;
+
+    const struct Tract *measured = engine->nvoices ? &choir.voices[0].tract : &tract;
+    fprintf(csv, "%s,%i,%.2f,%.4f,%i,%i,%i,%li,%.3f,%.2f\n",
+            engine->name, sample_rate, length, measured->tract_length, measured->nsegments, with_frication, with_interpolation,
+            frames, elapsed * 1e9 / frames, frames / (double)sample_rate / elapsed);
+    fflush(csv);
+
+    if(engine->nvoices)
+        free_choir(&choir);
+    else
+        free_tract(&tract);
+    free(source);
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-s seconds] [-v voices] [-c]\n"
+        "\n"
+        "  -s seconds   audio to render per configuration (default %.1f)\n"
+        "  -v voices    also time a choir of this many voices (2 to %i),\n"
+        "               run one by one and interleaved\n"
+        "  -c           dont time anything, check every engine against the reference\n"
+        "               and exit with 1 if any of them is too far off\n"
+        "\n"
+        "prints one line of csv per configuration to stdout\n"
+        "(for a choir ns_per_sample is for all the voices together)\n", name, DEFAULT_BENCH_SECONDS, MAX_VOICES);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    double seconds = DEFAULT_BENCH_SECONDS;
+    int nvoices = 0;
+    int check = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "s:v:ch")) != -1) {
+        switch(opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'v': nvoices = atoi(optarg); break;
+            case 'c': check = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(seconds <= 0 || (nvoices && (nvoices < 2 || nvoices > MAX_VOICES)))
+        usage(argv[0]);
+
+    // the note ons dont need logging
+    set_log_verbosity(LOG_QUIET);
+
+    // like the audio thread would
+    flush_denormals();
+
+    // the tract prints its setup on stdout
+    // keep the real stdout for the csv and throw the chatter away
+    FILE *csv = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    if(check) {
+        int failures = verify_engines(csv);
+        if(failures)
+            fprintf(stderr, "%i engines too far from the reference\n", failures);
+        fprintf(csv, "\n");
+        int wrong = verify_governor(csv);
+        if(wrong)
+            fprintf(stderr, "%i quality governor changes werent the ones it should have made\n", wrong);
+        fclose(csv);
+        return failures || wrong ? 1 : 0;
+    }
+
+    // the per sample reference and then the block path with every kernel the cpu can run
+    // and the fastest kernel without the fixed length ones
+    // and maybe a choir with the fastest kernel
+    struct Engine engines[nscatter_kernels + 4];
+    memset(engines, 0, sizeof(engines));
+    int nengines = 0;
+    strcpy(engines[nengines].name, "sample");
+    engines[nengines++].kernel = NULL;
+    const struct ScatterKernel *fastest = NULL;
+    for(int i = 0; i < nscatter_kernels; i++) {
+        if(!scatter_kernels[i].supported())
+            continue;
+        if(fastest == NULL)
+            fastest = &scatter_kernels[i];
+        snprintf(engines[nengines].name, sizeof(engines[nengines].name), "block/%s", scatter_kernels[i].name);
+        engines[nengines++].kernel = &scatter_kernels[i];
+    }
+    strcpy(engines[nengines].name, "block/generic");
+    engines[nengines].kernel = fastest;
+    engines[nengines++].generic = 1;
+    for(int interleave = 0; interleave < 2 && nvoices; interleave++) {
+        snprintf(engines[nengines].name, sizeof(engines[nengines].name), "choir%i/%s", nvoices, interleave ? "interleaved" : "serial");
+        engines[nengines].kernel = fastest;
+        engines[nengines].nvoices = nvoices;
+        engines[nengines++].interleave = interleave;
+    }
+
+    fprintf(csv, "engine,rate,desired_length_cm,actual_length_cm,nsegments,frication,interpolation,frames,ns_per_sample,realtime_factor\n");
+    for(int e = 0; e < nengines; e++)
+        for(int r = 0; r < ARRAY_LENGTH(rates); r++)
+            for(int l = 0; l < ARRAY_LENGTH(lengths); l++)
+                for(int f = 1; f >= 0; f--)
+                    for(int i = 1; i >= 0; i--)
+                        bench(csv, &engines[e], rates[r], lengths[l], f, i, seconds);
+
+    fclose(csv);
+    return 0;
+}
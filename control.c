@@ -0,0 +1,133 @@
+/*
+ * control events
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "control.h"
+
+// what each type is called in text
+static const char *control_names[NCONTROLS] = {
+    [CONTROL_PHONEME] = "phoneme",
+    [CONTROL_LENGTH] = "length",
+    [CONTROL_PRESSURE] = "pressure",
+    [CONTROL_DAMPING] = "damping",
+    [CONTROL_DRAG] = "drag",
+    [CONTROL_VELUM] = "velum",
+};
+
+void init_control_queue(struct ControlQueue *queue, int rate) {
+    memset(queue, 0, sizeof(struct ControlQueue));
+    queue->magic = CONTROL_MAGIC;
+    queue->rate = rate;
+}
+
+struct ControlQueue *share_control_queue(const char *name, int rate, int create) {
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+    if(fd < 0)
+        return NULL;
+    if(create && ftruncate(fd, sizeof(struct ControlQueue))) {
+        close(fd);
+        return NULL;
+    }
+    struct ControlQueue *queue = mmap(NULL, sizeof(struct ControlQueue), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(queue == MAP_FAILED)
+        return NULL;
+
+    // a fresh ring every time the tract side starts, whatever was left in it before
+    if(create)
+        init_control_queue(queue, rate);
+    else if(queue->magic != CONTROL_MAGIC) {
+        munmap(queue, sizeof(struct ControlQueue));
+        return NULL;
+    }
+    return queue;
+}
+
+void unshare_control_queue(struct ControlQueue *queue, const char *name, int unlink) {
+    munmap(queue, sizeof(struct ControlQueue));
+    if(unlink)
+        shm_unlink(name);
+}
+
+int send_control(struct ControlQueue *queue, const struct ControlEvent *event) {
+    unsigned long h = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if(h - atomic_load_explicit(&queue->tail, memory_order_acquire) >= CONTROL_QUEUE) {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    queue->events[h & (CONTROL_QUEUE - 1)] = *event;
+    atomic_store_explicit(&queue->head, h + 1, memory_order_release);
+    return 0;
+}
+
+const struct ControlEvent *peek_control(struct ControlQueue *queue, uint64_t end) {
+    unsigned long t = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if(t == atomic_load_explicit(&queue->head, memory_order_acquire))
+        return NULL;
+    const struct ControlEvent *event = &queue->events[t & (CONTROL_QUEUE - 1)];
+    return event->time < end ? event : NULL;
+}
+
+void pop_control(struct ControlQueue *queue) {
+    unsigned long t = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, t + 1, memory_order_release);
+}
+
+void publish_control_frame(struct ControlQueue *queue, uint64_t frame) {
+    atomic_store_explicit(&queue->frame, frame, memory_order_relaxed);
+}
+
+uint64_t control_frame(struct ControlQueue *queue) {
+    return atomic_load_explicit(&queue->frame, memory_order_relaxed);
+}
+
+int parse_control(const char *text, struct ControlEvent *event) {
+    while(isspace((unsigned char)*text))
+        text++;
+    const char *word = text;
+    while(*text && !isspace((unsigned char)*text))
+        text++;
+    size_t n = text - word;
+
+    event->type = -1;
+    for(int i = 0; i < NCONTROLS; i++)
+        if(strlen(control_names[i]) == n && !strncasecmp(word, control_names[i], n))
+            event->type = i;
+    if(event->type < 0)
+        return -1;
+
+    // phonemes take all three numbers, everything else just the one
+    double values[3];
+    int want = event->type == CONTROL_PHONEME ? 3 : 1;
+    for(int i = 0; i < want; i++) {
+        char *end;
+        values[i] = strtod(text, &end);
+        // strtod takes nan and inf too, which no control wants
+        if(end == text || !isfinite(values[i]))
+            return -1;
+        text = end;
+    }
+    while(isspace((unsigned char)*text))
+        text++;
+    if(*text)
+        return -1;
+
+    if(event->type == CONTROL_PHONEME) {
+        event->phoneme.tongue_height = values[0];
+        event->phoneme.tongue_position = values[1];
+        event->phoneme.lips_roundedness = values[2];
+    } else {
+        event->value = values[0];
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * control events
+ *
+ * another way to drive the tract than midi: timestamped parameter changes
+ * in real units through a lock-free ring buffer, so a controller in the same process
+ * (or another one, through shared memory) can move the tract around as fast as it likes
+ * without packing everything into 7 bit controllers or taking any locks
+ *
+ * theres one controller and one audio thread: the controller only ever moves head
+ * and the audio thread only ever moves tail (just like the logs)
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "phoneme.h"
+
+// how many events fit in the ring (a power of 2)
+#define CONTROL_QUEUE 1024
+
+// magic number at the start of a shared queue so nobody maps the wrong thing
+#define CONTROL_MAGIC 0x6e616e63
+
+// what an event changes
+#define CONTROL_PHONEME 0 // the shape every voice crossfades toward (like the tongue and lips ccs all at once)
+#define CONTROL_LENGTH 1 // tract length in cm
+#define CONTROL_PRESSURE 2 // air pressure from the lungs
+#define CONTROL_DAMPING 3
+#define CONTROL_DRAG 4 // how slowly the shape follows the phoneme
+#define CONTROL_VELUM 5 // 0 shut to 1 open
+#define NCONTROLS 6
+
+// a single parameter change
+// the values are clamped to the same ranges the midi controllers cover
+struct ControlEvent {
+    uint64_t time; // the frame its for, on the clock of whoever runs the tract (0 = as soon as possible)
+    int type;
+    union {
+        struct Phoneme phoneme; // CONTROL_PHONEME
+        double value; // everything else
+    };
+};
+
+struct ControlQueue {
+    uint32_t magic;
+    int rate; // the sample rate time counts in
+    atomic_ullong frame; // the first frame of the latest cycle the audio thread ran (see publish_control_frame())
+    atomic_ulong head; // moved by the controller
+    atomic_ulong tail; // moved by the audio thread
+    atomic_ulong dropped; // events that didnt fit
+    struct ControlEvent events[CONTROL_QUEUE];
+};
+
+// get an empty queue ready for a tract running at rate
+void init_control_queue(struct ControlQueue *queue, int rate);
+
+// put a queue in shared memory under name (like "/nancealoid") so another process can send to it
+// the tract side creates it, controllers open it with create = 0
+// returns NULL if it couldnt
+struct ControlQueue *share_control_queue(const char *name, int rate, int create);
+
+// unmap a shared queue (and remove the name too if unlink)
+void unshare_control_queue(struct ControlQueue *queue, const char *name, int unlink);
+
+// send an event (only the controller, theres one sender)
+// events should go in time order, anything thats already late happens straight away
+// never blocks: returns 0 if it went in, -1 if the ring was full (its dropped and counted)
+int send_control(struct ControlQueue *queue, const struct ControlEvent *event);
+
+// the next event due before the frame end, or NULL if theres none (only the audio thread)
+// it stays in the queue until pop_control()
+const struct ControlEvent *peek_control(struct ControlQueue *queue, uint64_t end);
+void pop_control(struct ControlQueue *queue);
+
+// tell controllers where the audio thread has got to (once a cycle, before draining)
+// so they can schedule events a little ahead of it
+void publish_control_frame(struct ControlQueue *queue, uint64_t frame);
+uint64_t control_frame(struct ControlQueue *queue);
+
+// parse an event from text like "length 15" or "phoneme 0.9 0 0" (the time isnt touched)
+// returns 0 on success
+int parse_control(const char *text, struct ControlEvent *event);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * fixed length tracts
+ *
+ * one always inlined span written for any length, then a copy of it for every
+ * length in FIXED_LENGTHS where the length is a constant, so gcc unrolls and
+ * vectorizes the whole tract with nothing left over at the ends
+ * built once for the baseline instruction set and once for avx2 like the gangs
+ * (no fused multiply adds either way)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fixed.h"
+#include "scatter.h"
+
+// more than the longest of FIXED_LENGTHS
+#define FIXED_MAX 64
+
+int fixed_kernels = 1;
+
+// everything that stays the same for the whole span (or ramps a bit every sample)
+// pulled out of the tract so it can all sit in registers
+struct FixedSpan {
+    sample_t k[FIXED_MAX];
+    const sample_t *k_step;
+    int ramping;
+    sample_t atten, pressure, fric;
+    sample_t glottis_gain, glottis_gain_step;
+    sample_t lips_gamma, lips_gamma_step;
+    sample_t lips_allpass, lips_step;
+    sample_t lips_state[4];
+    const sample_t *noise; // for the sample its on, left then right
+    int padded;
+};
+
+// one sample of run_tract_span() for a single tube from the glottis at 0 to the lips at nsegments-1
+static inline __attribute__((always_inline))
+void fixed_sample(struct FixedSpan *span, const sample_t *restrict old_left, const sample_t *restrict old_right,
+                  sample_t *restrict new_left, sample_t *restrict new_right, sample_t in, sample_t *out,
+                  const int nsegments, const int fricative) {
+    sample_t atten = span->atten;
+    const sample_t *k = span->k;
+    int lips = nsegments - 1;
+
+    // the glottis reflects everything and mixes in the source
+    new_right[0] = old_left[0] * atten + in * span->glottis_gain + span->pressure;
+
+    if(fricative) {
+        const sample_t *noise_left = span->noise;
+        const sample_t *noise_right = noise_left + span->padded;
+        for(int j = 1; j < nsegments; j++) {
+            sample_t r = old_right[j-1];
+            sample_t l = old_left[j];
+            sample_t back = r * k[j];
+            sample_t forth = -l * k[j];
+            sample_t wind_left = back > 0 ? back : 0;
+            sample_t wind_right = forth > 0 ? forth : 0;
+            new_right[j] = r - back + forth * atten + span->fric * wind_right * noise_right[j];
+            new_left[j-1] = l - forth + back * atten + span->fric * wind_left * noise_left[j];
+        }
+        span->noise += span->padded * 2;
+    } else {
+        for(int j = 1; j < nsegments; j++) {
+            sample_t r = old_right[j-1];
+            sample_t l = old_left[j];
+            new_right[j] = r - k[j] * (r + l * atten);
+            new_left[j-1] = l + k[j] * (l + r * atten);
+        }
+    }
+
+    // the lips let some out and reflect the rest
+    // going through the extra bit of length on the way out and back
+    sample_t a = span->lips_allpass;
+    sample_t *state = span->lips_state;
+    sample_t x = old_right[lips];
+    sample_t r = a * x + state[0] - a * state[1];
+    state[0] = x;
+    state[1] = r;
+    sample_t reflected = r * span->lips_gamma;
+    sample_t back = reflected * atten;
+    sample_t returned = a * back + state[2] - a * state[3];
+    state[2] = back;
+    state[3] = returned;
+    new_left[lips] = returned;
+    *out = r - reflected;
+    span->lips_allpass += span->lips_step;
+
+    if(span->ramping) {
+        for(int j = 1; j < nsegments; j++)
+            span->k[j] += span->k_step[j];
+        span->glottis_gain += span->glottis_gain_step;
+        span->lips_gamma += span->lips_gamma_step;
+    }
+}
+
+static inline __attribute__((always_inline))
+void fixed_span(struct Tract *tract, const sample_t *in, sample_t *out, int n, const int nsegments, const int fricative) {
+    struct FixedSpan span;
+    memcpy(span.k, tract->junction_gamma, sizeof(sample_t) * nsegments);
+    span.k_step = tract->junction_step;
+    span.ramping = tract->ramping;
+    span.atten = 1 - tract->damping;
+    span.pressure = tract->diaphram_pressure;
+    span.fric = tract->frication;
+    span.glottis_gain = tract->glottis_gain;
+    span.glottis_gain_step = tract->glottis_gain_step;
+    span.lips_gamma = tract->lips_gamma;
+    span.lips_gamma_step = tract->lips_gamma_step;
+    span.lips_allpass = tract->lips_allpass;
+    span.lips_step = tract->lips_allpass_step;
+    memcpy(span.lips_state, tract->lips_state, sizeof(span.lips_state));
+
+    // padded_length() but where the compiler can see it
+    int per_line = TRACT_ALIGN / sizeof(sample_t);
+    span.padded = (nsegments + per_line) / per_line * per_line;
+    if(fricative) {
+        fill_tract_noise(tract, n);
+        span.noise = tract->noise_buffer;
+    }
+
+    // the waves bounce between two local buffers instead of swapping pointers
+    // two samples at a time so which is which is known at compile time too
+    sample_t left[2][FIXED_MAX], right[2][FIXED_MAX];
+    memcpy(left[0], tract->left_front, sizeof(sample_t) * nsegments);
+    memcpy(right[0], tract->right_front, sizeof(sample_t) * nsegments);
+    int t = 0;
+    for(; t + 2 <= n; t += 2) {
+        fixed_sample(&span, left[0], right[0], left[1], right[1], in[t], out + t, nsegments, fricative);
+        fixed_sample(&span, left[1], right[1], left[0], right[0], in[t+1], out + t + 1, nsegments, fricative);
+    }
+    int last = 0;
+    if(t < n) {
+        fixed_sample(&span, left[0], right[0], left[1], right[1], in[t], out + t, nsegments, fricative);
+        last = 1;
+    }
+
+    // only the front buffer means anything between spans
+    memcpy(tract->left_front, left[last], sizeof(sample_t) * nsegments);
+    memcpy(tract->right_front, right[last], sizeof(sample_t) * nsegments);
+    if(span.ramping)
+        memcpy(tract->junction_gamma, span.k, sizeof(sample_t) * nsegments);
+    memcpy(tract->lips_state, span.lips_state, sizeof(span.lips_state));
+}
+
+#define FIXED_DEFAULT(n) \
+    static void fixed_scatter_##n(struct Tract *tract, const sample_t *in, sample_t *out, int frames) { \
+        fixed_span(tract, in, out, frames, n, 0); \
+    } \
+    static void fixed_frication_##n(struct Tract *tract, const sample_t *in, sample_t *out, int frames) { \
+        fixed_span(tract, in, out, frames, n, 1); \
+    }
+FIXED_LENGTHS(FIXED_DEFAULT)
+
+#define FIXED_ENTRY(n) { n, fixed_scatter_##n, fixed_frication_##n },
+static const struct FixedKernel fixed_default[] = { FIXED_LENGTHS(FIXED_ENTRY) };
+
+#define NFIXED (sizeof(fixed_default) / sizeof(*fixed_default))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FIXED_X86
+
+#define FIXED_AVX2(n) \
+    __attribute__((target("avx2"))) \
+    static void fixed_scatter_avx2_##n(struct Tract *tract, const sample_t *in, sample_t *out, int frames) { \
+        fixed_span(tract, in, out, frames, n, 0); \
+    } \
+    __attribute__((target("avx2"))) \
+    static void fixed_frication_avx2_##n(struct Tract *tract, const sample_t *in, sample_t *out, int frames) { \
+        fixed_span(tract, in, out, frames, n, 1); \
+    }
+FIXED_LENGTHS(FIXED_AVX2)
+
+#define FIXED_AVX2_ENTRY(n) { n, fixed_scatter_avx2_##n, fixed_frication_avx2_##n },
+static const struct FixedKernel fixed_avx2[] = { FIXED_LENGTHS(FIXED_AVX2_ENTRY) };
+#endif
+
+const struct FixedKernel *find_fixed_kernel(int nsegments) {
+    if(!fixed_kernels)
+        return NULL;
+    const struct FixedKernel *kernels = fixed_default;
+#ifdef FIXED_X86
+    if(scatter_kernel && !strcmp(scatter_kernel->name, "avx2"))
+        kernels = fixed_avx2;
+#endif
+    for(size_t i = 0; i < NFIXED; i++)
+        if(kernels[i].nsegments == nsegments)
+            return &kernels[i];
+    return NULL;
+}
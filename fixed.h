@@ -0,0 +1,37 @@
+/*
+ * fixed length tracts
+ *
+ * the block path for a tract thats just the one tube (velum shut) and exactly
+ * one of a few common lengths, with the number of segments known when its compiled
+ * so every loop has a constant trip count, the waves can live in local arrays
+ * instead of the tracts buffers and theres no kernel to call per sample
+ *
+ * same arithmetic in the same order as run_tract_span() so they sound exactly the same
+ */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "tract.h"
+
+// the lengths there are kernels for, in segments
+// 17.5cm at 44.1khz, 48khz, 88.2khz and 96khz
+#define FIXED_LENGTHS(X) X(22) X(23) X(44) X(48)
+
+// a span of a fixed length tract, without then with frication
+// (does what run_tract_span() does between start_span() and finish_span())
+struct FixedKernel {
+    int nsegments;
+    void (*scatter)(struct Tract *tract, const sample_t *in, sample_t *out, int n);
+    void (*frication)(struct Tract *tract, const sample_t *in, sample_t *out, int n);
+};
+
+// 0 = never use them, every tract goes through the generic loop
+// (read when the network is built, so set it before making any tracts)
+extern int fixed_kernels;
+
+// the kernel for a single tube nsegments long, NULL if theres no special one
+// (follows scatter_kernel, so NANCEALOID_KERNEL works here too)
+const struct FixedKernel *find_fixed_kernel(int nsegments);
+
+#endif
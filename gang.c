@@ -0,0 +1,333 @@
+/*
+ * voice interleaved tracts
+ *
+ * written with gcc vector types so its the same code for every instruction set,
+ * built once for the baseline one and once for avx2 (no fused multiply adds
+ * either way so every lane does the same arithmetic as the scalar scatter kernel)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "gang.h"
+#include "scatter.h"
+
+#define L GANG_LANES
+
+// GANG_LANES samples, one from every lane
+// gcc turns arithmetic on these into whatever vector ops the target has
+// (unaligned, so they can be loaded from anywhere)
+typedef sample_t lanes_t __attribute__((vector_size(sizeof(sample_t) * L), aligned(sizeof(sample_t))));
+typedef int32_t mask_t __attribute__((vector_size(sizeof(sample_t) * L), aligned(sizeof(sample_t))));
+typedef uint32_t state_t __attribute__((vector_size(sizeof(uint32_t) * L), aligned(sizeof(uint32_t))));
+
+#define LANES(p) (*(lanes_t *)(p))
+#define STATE(p) (*(state_t *)(p))
+
+// x if its positive, 0 otherwise (x > 0 ? x : 0 for every lane)
+#define POSITIVE(x) ((lanes_t)((mask_t)(x) & ((x) > 0)))
+
+// the span functions for one instruction set
+struct GangKernel {
+    void (*scatter)(struct Gang *gang, const sample_t *in, sample_t *out, int n);
+    void (*scatter_frication)(struct Gang *gang, const sample_t *in, sample_t *out, int n);
+};
+
+// make the noise for one sample of every lane
+// the same numbers fill_noise() would give each tract on its own:
+// noise sample m of a tract comes from generator m % NOISE_LANES, and the tracts
+// noise buffer is padded so generator g always makes the noise for segments j % NOISE_LANES == g
+// so generator g of every lane steps together as one vector
+static inline __attribute__((always_inline))
+void gang_noise(struct Gang *gang) {
+    int n = gang->nsegments;
+    int padded = padded_length(n);
+    for(int side = 0; side < 2; side++) {
+        sample_t *noise = gang->noise + side * n * L;
+        for(int row = 0; row < padded; row += NOISE_LANES) {
+            for(int g = 0; g < NOISE_LANES; g++) {
+                state_t x = STATE(gang->noise_state[g]);
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                STATE(gang->noise_state[g]) = x;
+                int j = row + g;
+                if(j < n)
+                    LANES(noise + j * L) = __builtin_convertvector((mask_t)x, lanes_t) * NOISE_SCALE;
+            }
+        }
+    }
+}
+
+// run a span of n samples
+// this is run_tract_span() with every sample_t turned into GANG_LANES of them
+static inline __attribute__((always_inline))
+void gang_span(struct Gang *gang, const sample_t *in, sample_t *out, int n, int fricative) {
+    sample_t *k = gang->junction_gamma;
+    const sample_t *k_step = gang->junction_step;
+    int ramping = gang->ramping;
+    lanes_t atten = LANES(gang->atten);
+    lanes_t glottis_gain = LANES(gang->glottis_gain);
+    lanes_t lips_gamma = LANES(gang->lips_gamma);
+    lanes_t pressure = LANES(gang->pressure);
+    lanes_t fric = LANES(gang->fric);
+    int nsegments = gang->nsegments;
+    int last = (nsegments - 1) * L;
+    sample_t *old_left = gang->left_front, *old_right = gang->right_front;
+    sample_t *new_left = gang->left_back, *new_right = gang->right_back;
+    lanes_t lips_allpass = LANES(gang->lips_allpass);
+    lanes_t lips_step = LANES(gang->lips_step);
+    lanes_t state0 = LANES(gang->lips_state[0]);
+    lanes_t state1 = LANES(gang->lips_state[1]);
+    lanes_t state2 = LANES(gang->lips_state[2]);
+    lanes_t state3 = LANES(gang->lips_state[3]);
+
+    for(int t = 0; t < n; t++) {
+        // the glottis reflects everything and mixes in the source
+        LANES(new_right) = LANES(old_left) * atten + LANES(in + t * L) * glottis_gain + pressure;
+
+        if(fricative) {
+            gang_noise(gang);
+            const sample_t *noise_left = gang->noise;
+            const sample_t *noise_right = noise_left + nsegments * L;
+            for(int j = L; j <= last; j += L) {
+                lanes_t r = LANES(old_right + j - L);
+                lanes_t l = LANES(old_left + j);
+                lanes_t back = r * LANES(k + j);
+                lanes_t forth = -l * LANES(k + j);
+                lanes_t wind_left = POSITIVE(back);
+                lanes_t wind_right = POSITIVE(forth);
+                LANES(new_right + j) = r - back + forth * atten + fric * wind_right * LANES(noise_right + j);
+                LANES(new_left + j - L) = l - forth + back * atten + fric * wind_left * LANES(noise_left + j);
+            }
+        } else {
+            for(int j = L; j <= last; j += L) {
+                lanes_t r = LANES(old_right + j - L);
+                lanes_t l = LANES(old_left + j);
+                lanes_t g = LANES(k + j);
+                LANES(new_right + j) = r - g * (r + l * atten);
+                LANES(new_left + j - L) = l + g * (l + r * atten);
+            }
+        }
+
+        // the lips let some out and reflect the rest
+        // going through the extra bit of length on the way out and back
+        lanes_t r = lips_allpass * LANES(old_right + last) + state0 - lips_allpass * state1;
+        state0 = LANES(old_right + last);
+        state1 = r;
+        lanes_t reflected = r * lips_gamma;
+        lanes_t back = reflected * atten;
+        lanes_t returned = lips_allpass * back + state2 - lips_allpass * state3;
+        state2 = back;
+        state3 = returned;
+        LANES(new_left + last) = returned;
+        LANES(out + t * L) = r - reflected;
+        lips_allpass += lips_step;
+
+        if(ramping) {
+            for(int j = L; j <= last; j += L)
+                LANES(k + j) += LANES(k_step + j);
+            glottis_gain += LANES(gang->glottis_gain_step);
+            lips_gamma += LANES(gang->lips_gamma_step);
+        }
+
+        sample_t *tmp = old_left;
+        old_left = new_left;
+        new_left = tmp;
+        tmp = old_right;
+        old_right = new_right;
+        new_right = tmp;
+    }
+
+    gang->left_front = old_left;
+    gang->right_front = old_right;
+    gang->left_back = new_left;
+    gang->right_back = new_right;
+    LANES(gang->lips_state[0]) = state0;
+    LANES(gang->lips_state[1]) = state1;
+    LANES(gang->lips_state[2]) = state2;
+    LANES(gang->lips_state[3]) = state3;
+}
+
+static void gang_scatter_default(struct Gang *gang, const sample_t *in, sample_t *out, int n) {
+    gang_span(gang, in, out, n, 0);
+}
+
+static void gang_frication_default(struct Gang *gang, const sample_t *in, sample_t *out, int n) {
+    gang_span(gang, in, out, n, 1);
+}
+
+static const struct GangKernel gang_default = { gang_scatter_default, gang_frication_default };
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GANG_X86
+
+__attribute__((target("avx2")))
+static void gang_scatter_avx2(struct Gang *gang, const sample_t *in, sample_t *out, int n) {
+    gang_span(gang, in, out, n, 0);
+}
+
+__attribute__((target("avx2")))
+static void gang_frication_avx2(struct Gang *gang, const sample_t *in, sample_t *out, int n) {
+    gang_span(gang, in, out, n, 1);
+}
+
+static const struct GangKernel gang_avx2 = { gang_scatter_avx2, gang_frication_avx2 };
+#endif
+
+// follow whatever the tracts are using (so NANCEALOID_KERNEL works here too)
+static const struct GangKernel *gang_kernel() {
+#ifdef GANG_X86
+    if(scatter_kernel && !strcmp(scatter_kernel->name, "avx2"))
+        return &gang_avx2;
+#endif
+    return &gang_default;
+}
+
+sample_t *alloc_gang_samples(int n) {
+    void *p;
+    size_t size = sizeof(sample_t) * n;
+    if(posix_memalign(&p, TRACT_ALIGN, size)) {
+        fprintf(stderr, "could not allocate gang memory\n");
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+void init_gang(struct Gang *gang, int capacity) {
+    memset(gang, 0, sizeof(struct Gang));
+    gang->capacity = capacity;
+    gang->waves = alloc_gang_samples(capacity * L * 4);
+    gang->junction_gamma = alloc_gang_samples(capacity * L);
+    gang->junction_step = alloc_gang_samples(capacity * L);
+    gang->noise = alloc_gang_samples(2 * capacity * L);
+}
+
+void free_gang(struct Gang *gang) {
+    free(gang->waves);
+    free(gang->junction_gamma);
+    free(gang->junction_step);
+    free(gang->noise);
+    gang->waves = gang->junction_gamma = gang->junction_step = gang->noise = NULL;
+}
+
+// frication on or off, the way run_tract_span() decides it
+static int fricative(const struct Tract *tract) {
+    return (sample_t)tract->frication != 0;
+}
+
+int same_gang(const struct Tract *a, const struct Tract *b) {
+    return a->nsegments == b->nsegments && fricative(a) == fricative(b) &&
+           a->control_period == b->control_period && !a->nose_open && !b->nose_open;
+}
+
+// copy a tracts coefficients (and their ramps if its ramping) into its lane
+static void load_coefficients(struct Gang *gang, int i) {
+    struct Tract *tract = gang->tracts[i];
+    int ramping = tract->ramping;
+    for(int j = 1; j < gang->nsegments; j++) {
+        gang->junction_gamma[j * L + i] = tract->junction_gamma[j];
+        gang->junction_step[j * L + i] = ramping ? tract->junction_step[j] : 0;
+    }
+    gang->glottis_gain[i] = tract->glottis_gain;
+    gang->glottis_gain_step[i] = ramping ? tract->glottis_gain_step : 0;
+    gang->lips_gamma[i] = tract->lips_gamma;
+    gang->lips_gamma_step[i] = ramping ? tract->lips_gamma_step : 0;
+}
+
+void load_gang(struct Gang *gang, struct Tract **tracts, int nlanes) {
+    int n = tracts[0]->nsegments;
+    if(n > gang->capacity) {
+        fprintf(stderr, "tract too long for the gang (%i segments)\n", n);
+        exit(1);
+    }
+
+    gang->nlanes = nlanes;
+    gang->nsegments = n;
+    gang->fricative = fricative(tracts[0]);
+    gang->left_front = gang->waves;
+    gang->right_front = gang->waves + gang->capacity * L;
+    gang->left_back = gang->waves + gang->capacity * L * 2;
+    gang->right_back = gang->waves + gang->capacity * L * 3;
+
+    // empty lanes are silent tracts that never make a sound
+    memset(gang->waves, 0, sizeof(sample_t) * gang->capacity * L * 4);
+    memset(gang->junction_gamma, 0, sizeof(sample_t) * gang->capacity * L);
+    memset(gang->junction_step, 0, sizeof(sample_t) * gang->capacity * L);
+    memset(gang->atten, 0, sizeof(gang->atten));
+    memset(gang->glottis_gain, 0, sizeof(gang->glottis_gain));
+    memset(gang->glottis_gain_step, 0, sizeof(gang->glottis_gain_step));
+    memset(gang->lips_gamma, 0, sizeof(gang->lips_gamma));
+    memset(gang->lips_gamma_step, 0, sizeof(gang->lips_gamma_step));
+    memset(gang->lips_allpass, 0, sizeof(gang->lips_allpass));
+    memset(gang->lips_step, 0, sizeof(gang->lips_step));
+    memset(gang->lips_state, 0, sizeof(gang->lips_state));
+    memset(gang->pressure, 0, sizeof(gang->pressure));
+    memset(gang->fric, 0, sizeof(gang->fric));
+    memset(gang->noise_state, 0, sizeof(gang->noise_state));
+
+    for(int i = 0; i < nlanes; i++) {
+        struct Tract *tract = tracts[i];
+        gang->tracts[i] = tract;
+        for(int j = 0; j < n; j++) {
+            gang->left_front[j * L + i] = tract->left_front[j];
+            gang->right_front[j * L + i] = tract->right_front[j];
+        }
+        gang->atten[i] = 1 - tract->damping;
+        gang->pressure[i] = tract->diaphram_pressure;
+        gang->fric[i] = tract->frication;
+        for(int g = 0; g < NOISE_LANES; g++)
+            gang->noise_state[g][i] = tract->noise.state[g];
+        for(int s = 0; s < 4; s++)
+            gang->lips_state[s][i] = tract->lips_state[s];
+        load_coefficients(gang, i);
+    }
+}
+
+void store_gang(struct Gang *gang) {
+    for(int i = 0; i < gang->nlanes; i++) {
+        struct Tract *tract = gang->tracts[i];
+        for(int j = 0; j < gang->nsegments; j++) {
+            tract->left_front[j] = gang->left_front[j * L + i];
+            tract->right_front[j] = gang->right_front[j * L + i];
+        }
+        for(int g = 0; g < NOISE_LANES; g++)
+            tract->noise.state[g] = gang->noise_state[g][i];
+        for(int s = 0; s < 4; s++)
+            tract->lips_state[s] = gang->lips_state[s][i];
+    }
+}
+
+void run_gang(struct Gang *gang, const sample_t *in, sample_t *out, int nframes) {
+    const struct GangKernel *kernel = gang_kernel();
+    int period = gang->tracts[0]->control_period;
+    for(int start = 0; start < nframes; start += period) {
+        int span = nframes - start < period ? nframes - start : period;
+
+        gang->ramping = 0;
+        for(int i = 0; i < gang->nlanes; i++) {
+            struct Tract *tract = gang->tracts[i];
+            if(start_span(tract, span))
+                load_coefficients(gang, i);
+            gang->ramping |= tract->ramping;
+            gang->lips_allpass[i] = tract->lips_allpass;
+            gang->lips_step[i] = tract->lips_allpass_step;
+        }
+
+        if(gang->fricative)
+            kernel->scatter_frication(gang, in + start * L, out + start * L, span);
+        else
+            kernel->scatter(gang, in + start * L, out + start * L, span);
+
+        // the ramping lanes land on their targets
+        for(int i = 0; i < gang->nlanes; i++) {
+            struct Tract *tract = gang->tracts[i];
+            int ramped = tract->ramping;
+            finish_span(tract, span);
+            if(ramped)
+                load_coefficients(gang, i);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * voice interleaved tracts
+ *
+ * runs up to GANG_LANES tracts of the same length in lockstep
+ * with the same segment of every tract side by side in memory,
+ * so each simd lane is its own tract and the loop over segments
+ * is exactly what run_tract_block() does for one of them
+ *
+ * the tracts keep their own state, a gang just borrows the waves
+ * for a block and hands them back after
+ */
+
+#ifndef GANG_H
+#define GANG_H
+
+#include "tract.h"
+
+// how many tracts run side by side (one avx register of floats)
+#define GANG_LANES 8
+
+struct Gang {
+    int nlanes; // how many lanes have a tract in them
+    int nsegments; // every tract in the gang is this long
+    int capacity; // most segments the buffers have room for
+    int fricative; // 1 = the tracts have frication on
+    struct Tract *tracts[GANG_LANES];
+
+    // the waves of every tract, segment j of lane i is at [j * GANG_LANES + i]
+    sample_t *left_front, *right_front;
+    sample_t *left_back, *right_back;
+    sample_t *waves; // one allocation holding all four
+
+    // coefficients, interleaved the same way
+    // and how much they change every sample (0 for lanes that arent ramping)
+    sample_t *junction_gamma;
+    sample_t *junction_step;
+    sample_t atten[GANG_LANES];
+    sample_t glottis_gain[GANG_LANES];
+    sample_t glottis_gain_step[GANG_LANES];
+    sample_t lips_gamma[GANG_LANES];
+    sample_t lips_gamma_step[GANG_LANES];
+    int ramping; // 1 if any lane is ramping this span
+    sample_t lips_allpass[GANG_LANES]; // the extra length at the start of the span
+    sample_t lips_step[GANG_LANES]; // and how much it changes every sample
+    sample_t lips_state[4][GANG_LANES]; // see struct Tract
+    sample_t pressure[GANG_LANES];
+    sample_t fric[GANG_LANES];
+
+    // every lanes frication noise generators, generator g of lane i is [g][i]
+    uint32_t noise_state[NOISE_LANES][GANG_LANES];
+
+    // every lanes noise for one sample, [(side * nsegments + j) * GANG_LANES + i]
+    // (side 0 = left moving waves, 1 = right moving waves)
+    sample_t *noise;
+};
+
+// allocate a gang for tracts of up to capacity segments
+void init_gang(struct Gang *gang, int capacity);
+
+void free_gang(struct Gang *gang);
+
+// 1 if two tracts can run in the same gang
+int same_gang(const struct Tract *a, const struct Tract *b);
+
+// take the waves out of some tracts (all the same length, nlanes <= GANG_LANES)
+void load_gang(struct Gang *gang, struct Tract **tracts, int nlanes);
+
+// give the waves back
+void store_gang(struct Gang *gang);
+
+// run every tract in the gang for a block of samples
+// in and out are interleaved by lane too, sample t of lane i is at [t * GANG_LANES + i]
+// each lane comes out exactly the same as run_tract_block() on its own
+void run_gang(struct Gang *gang, const sample_t *in, sample_t *out, int nframes);
+
+#endif
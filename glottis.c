@@ -0,0 +1,129 @@
+/*
+ * glottal source
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "glottis.h"
+
+// one extra sample on the end of every table so interpolating never wraps
+static float tables[GLOTTIS_LEVELS][GLOTTIS_TABLE_SIZE + 1];
+static int have_tables = 0;
+
+// the lf model for one value of alpha (how fast the open phase grows)
+// e0 = 1, eps comes from the return phase timing
+static void lf_period(double *out, int n, double alpha, double eps) {
+    double wg = M_PI / LF_TP;
+    double ee = -exp(alpha * LF_TE) * sin(wg * LF_TE);
+    for(int i = 0; i < n; i++) {
+        double t = (double)i / n;
+        if(t <= LF_TE)
+            out[i] = exp(alpha * t) * sin(wg * t);
+        else
+            out[i] = -ee / (eps * LF_TA) * (exp(-eps * (t - LF_TE)) - exp(-eps * (1 - LF_TE)));
+    }
+}
+
+static double mean(const double *x, int n) {
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+        sum += x[i];
+    return sum / n;
+}
+
+void init_glottis() {
+    if(have_tables)
+        return;
+
+    // eps * ta = 1 - e^(-eps * (1 - te)), close enough after a few goes
+    double eps = 1 / LF_TA;
+    for(int i = 0; i < 100; i++)
+        eps = (1 - exp(-eps * (1 - LF_TE))) / LF_TA;
+
+    // and alpha so no air is left over at the end of the period (the derivative adds up to 0)
+    // more alpha = more of the negative bit, so just bisect it
+    int n = GLOTTIS_TABLE_SIZE;
+    double *period = malloc(sizeof(double) * n);
+    double lo = -100, hi = 100;
+    for(int i = 0; i < 100; i++) {
+        double alpha = (lo + hi) / 2;
+        lf_period(period, n, alpha, eps);
+        if(mean(period, n) > 0)
+            lo = alpha;
+        else
+            hi = alpha;
+    }
+    lf_period(period, n, (lo + hi) / 2, eps);
+
+    // the harmonics of it
+    int nharmonics = 1 << (GLOTTIS_LEVELS - 1);
+    double *re = malloc(sizeof(double) * (nharmonics + 1));
+    double *im = malloc(sizeof(double) * (nharmonics + 1));
+    for(int k = 1; k <= nharmonics; k++) {
+        re[k] = im[k] = 0;
+        for(int i = 0; i < n; i++) {
+            double w = 2 * M_PI * k * i / n;
+            re[k] += period[i] * cos(w);
+            im[k] += period[i] * sin(w);
+        }
+        re[k] *= 2.0 / n;
+        im[k] *= 2.0 / n;
+    }
+
+    // every table has twice the harmonics of the one before
+    // all scaled the same (by the full one) so switching tables doesnt change the level
+    double peak = 0;
+    for(int level = GLOTTIS_LEVELS - 1; level >= 0; level--) {
+        int harmonics = 1 << level;
+        for(int i = 0; i < n; i++) {
+            double x = 0;
+            for(int k = 1; k <= harmonics; k++) {
+                double w = 2 * M_PI * k * i / n;
+                x += re[k] * cos(w) + im[k] * sin(w);
+            }
+            period[i] = x;
+            if(level == GLOTTIS_LEVELS - 1 && fabs(x) > peak)
+                peak = fabs(x);
+        }
+        for(int i = 0; i < n; i++)
+            tables[level][i] = period[i] / peak * GLOTTIS_LEVEL;
+        tables[level][n] = tables[level][0];
+    }
+
+    free(period);
+    free(re);
+    free(im);
+    have_tables = 1;
+}
+
+double note_frequency(uint8_t note) {
+    return 440 * pow(2, (note - 69) / 12.0);
+}
+
+void start_glottis(struct Glottis *glottis, double frequency, int rate) {
+    glottis->phase = 0;
+    glottis->step = frequency / rate;
+
+    // as many harmonics as fit under nyquist
+    int level = 0;
+    while(level < GLOTTIS_LEVELS - 1 && (2 << level) * frequency < rate / 2.0)
+        level++;
+    glottis->table = tables[level];
+}
+
+void run_glottis(struct Glottis *glottis, sample_t *out, int n) {
+    const float *table = glottis->table;
+    double phase = glottis->phase;
+    for(int i = 0; i < n; i++) {
+        double pos = phase * GLOTTIS_TABLE_SIZE;
+        int j = (int)pos;
+        double frac = pos - j;
+        out[i] += table[j] + (table[j + 1] - table[j]) * frac;
+        phase += glottis->step;
+        if(phase >= 1)
+            phase -= 1;
+    }
+    glottis->phase = phase;
+}
@@ -0,0 +1,49 @@
+/*
+ * glottal source
+ *
+ * a built in oscillator so the tract doesnt need another synth feeding it
+ * one period of the liljencrants-fant (lf) model of glottal flow derivative,
+ * turned into band limited wavetables (one per octave of harmonics) so
+ * it never aliases whatever pitch its played at
+ */
+
+#ifndef GLOTTIS_H
+#define GLOTTIS_H
+
+#include "tract.h"
+
+// samples in one period of a wavetable
+#define GLOTTIS_TABLE_SIZE 2048
+
+// tables with 1, 2, 4 ... 1024 harmonics
+#define GLOTTIS_LEVELS 11
+
+// lf model timing, as fractions of a period
+#define LF_TP 0.4 // peak flow
+#define LF_TE 0.55 // the glottis snaps shut (the big negative spike)
+#define LF_TA 0.02 // how quickly the flow stops after that
+
+// how loud the source is at full velocity
+// (about what the sawtooths people were feeding it came in at)
+#define GLOTTIS_LEVEL 0.3
+
+// one oscillator
+struct Glottis {
+    double phase; // 0 to 1 through the period
+    double step; // how far it goes every sample
+    const float *table; // which harmonics it can play without aliasing
+};
+
+// work out the tables (does nothing after the first time)
+void init_glottis();
+
+// the frequency of a midi note
+double note_frequency(uint8_t note);
+
+// start an oscillator at some frequency (from the start of a period)
+void start_glottis(struct Glottis *glottis, double frequency, int rate);
+
+// add n samples of the source to out
+void run_glottis(struct Glottis *glottis, sample_t *out, int n);
+
+#endif
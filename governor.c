@@ -0,0 +1,148 @@
+/*
+ * quality governor
+ */
+
+#include "governor.h"
+#include "rtlog.h"
+
+static const char *quality_names[NQUALITY] = {
+    [QUALITY_FULL] = "full",
+    [QUALITY_PERIOD] = "shape updates halved",
+    [QUALITY_PERIOD2] = "shape updates quartered",
+    [QUALITY_NOISE] = "no frication",
+    [QUALITY_VOICES] = "half the voices",
+    [QUALITY_VOICES2] = "a quarter of the voices",
+};
+
+const char *quality_name(int level) {
+    return level >= 0 && level < NQUALITY ? quality_names[level] : "?";
+}
+
+void init_governor(struct Governor *governor, const struct Choir *choir, int rate) {
+    const struct Tract *tract = &choir->voices[0].tract;
+    governor->level = QUALITY_FULL;
+    governor->period = tract->control_period;
+    governor->frication = tract->frication;
+    governor->nvoices = choir->nvoices;
+    governor->load = 0;
+    governor->smooth = GOVERN_SMOOTH * rate;
+    governor->over = governor->under = governor->since = 0;
+    governor->hold_down = GOVERN_HOLD_DOWN * rate;
+    governor->hold_up = GOVERN_HOLD_UP * rate;
+    governor->settle = GOVERN_SETTLE * rate;
+    governor->went_up = 0;
+    governor->failed = -1;
+    governor->backoff = 1;
+}
+
+// what every level turns each thing down to
+static int quality_period(const struct Governor *governor, int level) {
+    int shift = level >= QUALITY_PERIOD2 ? 2 : level >= QUALITY_PERIOD ? 1 : 0;
+    int period = governor->period << shift;
+    return period < MAX_CONTROL_PERIOD ? period : MAX_CONTROL_PERIOD;
+}
+
+static double quality_frication(const struct Governor *governor, int level) {
+    return level >= QUALITY_NOISE ? 0 : governor->frication;
+}
+
+static int quality_voices(const struct Governor *governor, int level) {
+    int nvoices = governor->nvoices;
+    if(level >= QUALITY_VOICES2)
+        nvoices /= 4;
+    else if(level >= QUALITY_VOICES)
+        nvoices /= 2;
+    return nvoices > 1 ? nvoices : 1;
+}
+
+// 1 if a level is any cheaper than the one before it
+// (the control period might be as long as it goes already, or theres no noise to turn off)
+static int quality_differs(const struct Governor *governor, int level) {
+    return quality_period(governor, level) != quality_period(governor, level - 1) ||
+           quality_frication(governor, level) != quality_frication(governor, level - 1) ||
+           quality_voices(governor, level) != quality_voices(governor, level - 1);
+}
+
+// the next level down that does something, or the one its on if there isnt one
+static int lower_quality(const struct Governor *governor) {
+    for(int level = governor->level + 1; level < NQUALITY; level++)
+        if(quality_differs(governor, level))
+            return level;
+    return governor->level;
+}
+
+// and the next one up, skipping levels that are no different to the one above
+static int higher_quality(const struct Governor *governor) {
+    if(governor->level == QUALITY_FULL)
+        return QUALITY_FULL;
+    int level = governor->level - 1;
+    while(level > QUALITY_FULL && !quality_differs(governor, level))
+        level--;
+    return level;
+}
+
+// put the choir at a level of quality
+static void set_quality(struct Governor *governor, struct Choir *choir, int level) {
+    set_choir_control_period(choir, quality_period(governor, level));
+    double frication = quality_frication(governor, level);
+    for(int i = 0; i < choir->nvoices; i++)
+        choir->voices[i].tract.frication = frication;
+    limit_choir(choir, quality_voices(governor, level));
+
+    governor->level = level;
+    governor->over = governor->under = governor->since = 0;
+}
+
+void govern_choir(struct Governor *governor, struct Choir *choir, uint64_t busy_ns, uint64_t period_ns, int nframes) {
+    if(period_ns == 0)
+        return;
+    double load = (double)busy_ns / period_ns;
+    double x = nframes < governor->smooth ? nframes / governor->smooth : 1;
+    governor->load += (load - governor->load) * x;
+    governor->since += nframes;
+
+    if(governor->load > GOVERN_HIGH) {
+        governor->over += nframes;
+        governor->under = 0;
+    } else if(governor->load < GOVERN_LOW) {
+        governor->under += nframes;
+        governor->over = 0;
+    } else {
+        governor->over = governor->under = 0;
+    }
+
+    // a block that took longer than it had is an xrun, dont wait around for another
+    // (unless its just the odd slow one, turning the quality down wouldnt help that)
+    int level = governor->level;
+    int up = higher_quality(governor);
+    long hold_up = governor->hold_up * (up == governor->failed ? governor->backoff : 1);
+    int xrun = load >= 1 && governor->load > GOVERN_HIGH && governor->since >= governor->settle;
+    if(governor->over >= governor->hold_down || xrun)
+        level = lower_quality(governor);
+    else if(governor->under >= hold_up)
+        level = up;
+    if(level == governor->level) {
+        // nowhere to go, start holding again
+        if(governor->over >= governor->hold_down || governor->under >= hold_up)
+            governor->over = governor->under = 0;
+        return;
+    }
+
+    // going back down right after going up means that level is too much for now
+    if(level > governor->level) {
+        if(governor->went_up && governor->since < governor->hold_up) {
+            if(governor->failed != governor->level)
+                governor->backoff = 2;
+            else if(governor->backoff < GOVERN_BACKOFF)
+                governor->backoff *= 2;
+            governor->failed = governor->level;
+        } else {
+            governor->failed = -1;
+            governor->backoff = 1;
+        }
+    }
+    governor->went_up = level < governor->level;
+
+    rt_log(LOG_INFO, "quality %i -> %i (%s) at %.0f%% load\n", governor->level, level, quality_name(level), governor->load * 100);
+    set_quality(governor, choir, level);
+}
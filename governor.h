@@ -0,0 +1,81 @@
+/*
+ * quality governor
+ *
+ * when the machine cant keep up the choir gets a bit worse instead of xrunning
+ * every block says how much of its period it took, if thats too much for long
+ * enough the quality steps down a level, and once its been comfortably low
+ * for a good while longer it steps back up (so it doesnt flap between two)
+ *
+ * every level keeps everything the ones before it did
+ */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdint.h>
+
+#include "voice.h"
+
+// the levels, cheapest thing to give up first
+#define QUALITY_FULL 0
+#define QUALITY_PERIOD 1 // shape updates half as often
+#define QUALITY_PERIOD2 2 // a quarter as often
+#define QUALITY_NOISE 3 // no frication noise
+#define QUALITY_VOICES 4 // only half the voices (the oldest notes past them get let go)
+#define QUALITY_VOICES2 5 // a quarter of them
+#define NQUALITY 6
+
+// how much of the period a block can take before its too much, and before it can have some back
+#define GOVERN_HIGH 0.75
+#define GOVERN_LOW 0.4
+
+// how long it has to stay past those before anything changes (seconds)
+// much longer going up than down, so a change has time to show before the next one
+#define GOVERN_HOLD_DOWN 0.25
+#define GOVERN_HOLD_UP 3.0
+
+// the load it goes by is smoothed over about this long (seconds)
+// so one quick block doesnt start the holding over again
+#define GOVERN_SMOOTH 0.05
+
+// if stepping up has to step straight back down again (within GOVERN_HOLD_UP)
+// it waits twice as long before trying that level again, up to this many times as long
+// (some levels save a lot more than the gap between GOVERN_LOW and GOVERN_HIGH)
+#define GOVERN_BACKOFF 8
+
+// a block that takes longer than its period while its busy steps down straight away
+// but not again until this long after the last change (seconds)
+#define GOVERN_SETTLE 0.05
+
+struct Governor {
+    int level;
+
+    // what the choir was at full quality
+    int period;
+    double frication;
+    int nvoices;
+
+    double load; // smoothed, 1 = the whole period
+    double smooth; // GOVERN_SMOOTH in frames
+
+    // frames the load has been over GOVERN_HIGH (or under GOVERN_LOW) in a row
+    long over, under;
+    long since; // frames since the last change
+    int went_up; // the last change was a step up
+    int failed; // the level that was too much the last time it stepped up to it (-1 = none)
+    int backoff; // how many times GOVERN_HOLD_UP to wait before trying that one again
+    long hold_down, hold_up, settle; // GOVERN_HOLD_DOWN, GOVERN_HOLD_UP and GOVERN_SETTLE in frames
+};
+
+// start at full quality with whatever the choir is set up for now
+// (so after its control period and everything is set)
+void init_governor(struct Governor *governor, const struct Choir *choir, int rate);
+
+// after every block with how long it took and how long it could have taken
+// maybe changes the choirs quality (only the audio thread, never blocks, logs through rt_log())
+void govern_choir(struct Governor *governor, struct Choir *choir, uint64_t busy_ns, uint64_t period_ns, int nframes);
+
+// what a level is called
+const char *quality_name(int level);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * nancealoid as an lv2 plugin
+ *
+ * the same engine as the jack client but running right in the host,
+ * so theres no other process to switch to every period
+ * and hosts can render it offline as fast as it goes
+ *
+ * a choir of PLUGIN_VOICES singing the midi with the built in glottal source
+ * (anything coming in the source port gets added on top, like -g)
+ * and the midi controllers do what they always do
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lv2/core/lv2.h>
+#include <lv2/atom/atom.h>
+#include <lv2/atom/util.h>
+#include <lv2/midi/midi.h>
+#include <lv2/urid/urid.h>
+
+#include "nancealoid.h"
+#include "rtlog.h"
+
+#define PLUGIN_URI "urn:nancealoid:nancealoid"
+
+// how many notes can sound at once
+#define PLUGIN_VOICES 8
+
+// the ports, in the order of nancealoid.lv2/nancealoid.ttl
+#define PORT_CONTROL 0 // midi in
+#define PORT_SOURCE 1 // glottal source in
+#define PORT_OUTPUT 2 // vocal tract out
+
+struct Plugin {
+    struct Nancealoid nancealoid;
+    LV2_URID midi_event;
+
+    const LV2_Atom_Sequence *control;
+    const float *source;
+    float *output;
+
+    // how far through the sequence the engine has got this run
+    const LV2_Atom_Event *next;
+};
+
+// hands the engine the midi out of the atom sequence one event at a time
+// (skipping anything in there that isnt midi)
+static int next_lv2_midi(void *arg, struct MidiEvent *event) {
+    struct Plugin *plugin = arg;
+    const LV2_Atom_Sequence *seq = plugin->control;
+    for(; !lv2_atom_sequence_is_end(&seq->body, seq->atom.size, plugin->next); plugin->next = lv2_atom_sequence_next(plugin->next)) {
+        const LV2_Atom_Event *e = plugin->next;
+        if(e->body.type != plugin->midi_event)
+            continue;
+        event->time = e->time.frames;
+        event->buffer = (const uint8_t *)(e + 1);
+        event->size = e->body.size;
+        plugin->next = lv2_atom_sequence_next(e);
+        return 0;
+    }
+    return -1;
+}
+
+static LV2_Handle instantiate(const LV2_Descriptor *descriptor, double rate, const char *bundle_path, const LV2_Feature *const *features) {
+    LV2_URID_Map *map = NULL;
+    for(int i = 0; features[i]; i++)
+        if(!strcmp(features[i]->URI, LV2_URID__map))
+            map = features[i]->data;
+    if(map == NULL)
+        return NULL;
+
+    struct Plugin *plugin = calloc(1, sizeof(struct Plugin));
+    if(plugin == NULL)
+        return NULL;
+    plugin->midi_event = map->map(map->handle, LV2_MIDI__MidiEvent);
+
+    // theres no log thread in here to print anything, and stdout is the hosts
+    set_log_verbosity(LOG_QUIET);
+    if(init_quiet_nancealoid(&plugin->nancealoid, PLUGIN_VOICES, rate, 0)) {
+        free(plugin);
+        return NULL;
+    }
+    use_glottis(&plugin->nancealoid.choir);
+    return plugin;
+}
+
+static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
+    struct Plugin *plugin = instance;
+    switch(port) {
+        case PORT_CONTROL: plugin->control = data; break;
+        case PORT_SOURCE: plugin->source = data; break;
+        case PORT_OUTPUT: plugin->output = data; break;
+    }
+}
+
+static void run(LV2_Handle instance, uint32_t nframes) {
+    struct Plugin *plugin = instance;
+    plugin->next = lv2_atom_sequence_begin(&plugin->control->body);
+    struct MidiSource midi = { next_lv2_midi, plugin };
+    run_nancealoid(&plugin->nancealoid, plugin->source, plugin->output, nframes, &midi);
+}
+
+static void cleanup(LV2_Handle instance) {
+    struct Plugin *plugin = instance;
+    free_nancealoid(&plugin->nancealoid);
+    free(plugin);
+}
+
+static const LV2_Descriptor descriptor = {
+    PLUGIN_URI,
+    instantiate,
+    connect_port,
+    NULL, // activate
+    run,
+    NULL, // deactivate
+    cleanup,
+    NULL, // extension_data
+};
+
+LV2_SYMBOL_EXPORT const LV2_Descriptor *lv2_descriptor(uint32_t index) {
+    return index == 0 ? &descriptor : NULL;
+}
@@ -0,0 +1,143 @@
+/*
+ * the engine
+ */
+
+#include <string.h>
+#include "nancealoid.h"
+
+static int build_nancealoid(struct Nancealoid *nancealoid, int nvoices, int rate, int inside_rate, int quiet) {
+    memset(nancealoid, 0, sizeof(struct Nancealoid));
+    nancealoid->rate = rate;
+    if(quiet)
+        init_quiet_choir(&nancealoid->choir, nvoices, inside_rate ? inside_rate : rate, TRACT_LENGTH);
+    else
+        init_choir(&nancealoid->choir, nvoices, inside_rate ? inside_rate : rate, TRACT_LENGTH);
+    if(resample_choir(&nancealoid->choir, rate)) {
+        free_choir(&nancealoid->choir);
+        return -1;
+    }
+    return 0;
+}
+
+int init_nancealoid(struct Nancealoid *nancealoid, int nvoices, int rate, int inside_rate) {
+    return build_nancealoid(nancealoid, nvoices, rate, inside_rate, 0);
+}
+
+int init_quiet_nancealoid(struct Nancealoid *nancealoid, int nvoices, int rate, int inside_rate) {
+    return build_nancealoid(nancealoid, nvoices, rate, inside_rate, 1);
+}
+
+void free_nancealoid(struct Nancealoid *nancealoid) {
+    free_choir(&nancealoid->choir);
+}
+
+void time_nancealoid(struct Nancealoid *nancealoid, struct Stats *stats) {
+    nancealoid->stats = stats;
+    time_choir(&nancealoid->choir, stats != NULL);
+}
+
+void govern_nancealoid(struct Nancealoid *nancealoid, struct Governor *governor) {
+    nancealoid->governor = governor;
+    if(governor)
+        init_governor(governor, &nancealoid->choir, nancealoid->rate);
+}
+
+// run the choir, keeping count of how long it took
+static void run_choir_timed(struct Nancealoid *nancealoid, const sample_t *in, sample_t *out, int n, uint64_t *ns) {
+    uint64_t start = nancealoid->stats ? clock_ns() : 0;
+    run_choir(&nancealoid->choir, in, out, n);
+    if(nancealoid->stats)
+        *ns += clock_ns() - start;
+}
+
+// the voice to show: the newest note thats sounding, or the first voice if none are
+static const struct Tract *viewed_tract(const struct Choir *choir) {
+    const struct Voice *newest = &choir->voices[0];
+    for(int i = 0; i < choir->nvoices; i++) {
+        const struct Voice *voice = &choir->voices[i];
+        if(voice->active && (!newest->active || voice->age > newest->age))
+            newest = voice;
+    }
+    return &newest->tract;
+}
+
+// the next midi event, clamped into the block (nframes if there isnt one)
+static uint32_t next_midi(const struct MidiSource *midi, struct MidiEvent *event, int nframes) {
+    if(midi == NULL || midi->next(midi->arg, event))
+        return nframes;
+    return event->time < (uint32_t)nframes ? event->time : nframes - 1;
+}
+
+void run_nancealoid(struct Nancealoid *nancealoid, const sample_t *in, sample_t *out, int nframes, const struct MidiSource *midi) {
+    // some hosts do this
+    if(nframes <= 0)
+        return;
+    // the choir flushes denormals, but this might be someone elses thread (a plugin host)
+    // so it gets its floating point mode back after
+    uint64_t mode = flush_denormals();
+    int timing = nancealoid->stats || nancealoid->governor;
+    uint64_t start = timing ? clock_ns() : 0;
+    uint64_t tracts_ns = 0;
+    struct ControlQueue *controls = nancealoid->controls;
+
+    // the control events due this block are the ones before the end of it
+    uint64_t first = nancealoid->frames;
+    nancealoid->frames += nframes;
+    if(controls)
+        publish_control_frame(controls, first);
+
+    // run the tracts with the glottal source and get the tract output
+    // stopping at every event so it happens on exactly the frame it was sent for
+    // (hosts hand the midi over in order, and the controller sends its events in order)
+    // midi goes first if theyre both for the same frame
+    uint32_t done = 0;
+    struct MidiEvent event;
+    uint32_t midi_time = next_midi(midi, &event, nframes);
+    for(;;) {
+        const struct ControlEvent *control = controls ? peek_control(controls, nancealoid->frames) : NULL;
+        uint32_t control_time = control ? (control->time > first ? control->time - first : 0) : nframes;
+        uint32_t time = midi_time <= control_time ? midi_time : control_time;
+        if(time == nframes)
+            break;
+        if(time > done) {
+            run_choir_timed(nancealoid, in + done, out + done, time - done, &tracts_ns);
+            done = time;
+        }
+        if(midi_time <= control_time) {
+            choir_midi(&nancealoid->choir, event.buffer, event.size);
+            midi_time = next_midi(midi, &event, nframes);
+        } else {
+            choir_control(&nancealoid->choir, control);
+            pop_control(controls);
+        }
+    }
+    if(done < nframes)
+        run_choir_timed(nancealoid, in + done, out + done, nframes - done, &tracts_ns);
+
+    // every voice is done with its tract for this block so its safe to look
+    if(nancealoid->view) {
+        nancealoid->view_countdown -= nframes;
+        if(nancealoid->view_countdown <= 0) {
+            nancealoid->view_countdown += nancealoid->rate / VIEW_RATE;
+            publish_tract_view(nancealoid->view, viewed_tract(&nancealoid->choir), first, nancealoid->rate);
+        }
+    }
+
+    restore_denormals(mode);
+    if(!timing)
+        return;
+    uint64_t busy = clock_ns() - start;
+    uint64_t period_ns = (uint64_t)nframes * 1000000000 / nancealoid->rate;
+
+    // whatever wasnt the tracts was the midi
+    if(nancealoid->stats) {
+        uint64_t stage_ns[NSTAGES];
+        stage_ns[STAGE_SHAPE] = take_choir_shape_ns(&nancealoid->choir);
+        stage_ns[STAGE_SCATTER] = tracts_ns > stage_ns[STAGE_SHAPE] ? tracts_ns - stage_ns[STAGE_SHAPE] : 0;
+        stage_ns[STAGE_MIDI] = busy - tracts_ns;
+        stats_cycle(nancealoid->stats, busy, period_ns, stage_ns);
+    }
+
+    if(nancealoid->governor)
+        govern_choir(nancealoid->governor, &nancealoid->choir, busy, period_ns, nframes);
+}
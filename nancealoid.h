@@ -0,0 +1,83 @@
+/*
+ * the engine
+ *
+ * everything a host has to do to run nancealoid, whatever the host is:
+ * a choir of tracts, midi and control events split into the block on exactly
+ * the frame theyre for, and timing it all if anyones asking
+ *
+ * the jack client (main.c) and the lv2 plugin (lv2.c) are both just this
+ * plus getting audio and midi in and out of their host
+ */
+
+#ifndef NANCEALOID_H
+#define NANCEALOID_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "tract.h"
+#include "voice.h"
+#include "control.h"
+#include "stats.h"
+#include "view.h"
+#include "governor.h"
+
+// a midi message somewhere in a block
+struct MidiEvent {
+    uint32_t time; // frames from the start of the block
+    const uint8_t *buffer;
+    size_t size;
+};
+
+// however the host keeps its midi, handed over one event at a time in time order
+// next() fills in the next event and returns 0, or returns -1 when there are no more
+struct MidiSource {
+    int (*next)(void *arg, struct MidiEvent *event);
+    void *arg;
+};
+
+struct Nancealoid {
+    struct Choir choir;
+    int rate; // the hosts sample rate
+
+    // control events (NULL = just midi)
+    struct ControlQueue *controls;
+
+    // frames run since the start, what control event times count in
+    // (hosts own frame times wrap or jump around)
+    uint64_t frames;
+
+    // how the blocks are keeping up (NULL = dont look at the clock)
+    struct Stats *stats;
+
+    // turns the quality down when the blocks take too long (NULL = never)
+    struct Governor *governor;
+
+    // where to show what the tract is doing VIEW_RATE times a second (NULL = nowhere)
+    struct ViewChannel *view;
+    int view_countdown; // frames until the next one
+};
+
+// a choir of nvoices singing at rate (or running at inside_rate and resampled to rate, 0 = the same)
+// returns 0 on success, -1 if it cant resample between the two
+int init_nancealoid(struct Nancealoid *nancealoid, int nvoices, int rate, int inside_rate);
+
+// the same but nothing gets printed (for hosts whose stdout isnt ours)
+int init_quiet_nancealoid(struct Nancealoid *nancealoid, int nvoices, int rate, int inside_rate);
+
+void free_nancealoid(struct Nancealoid *nancealoid);
+
+// count every block in stats (and how long the voices spend on shape updates), NULL stops
+void time_nancealoid(struct Nancealoid *nancealoid, struct Stats *stats);
+
+// let the governor trade quality for time whenever the blocks get too slow, NULL stops
+// (starts it off from however the choir is set up right now)
+void govern_nancealoid(struct Nancealoid *nancealoid, struct Governor *governor);
+
+// run a block of nframes: the glottal source goes in, the voices come out
+// stopping at every midi and control event so it happens right on its frame
+// (midi first if theyre both for the same one)
+// midi can be NULL if theres none this block
+void run_nancealoid(struct Nancealoid *nancealoid, const sample_t *in, sample_t *out, int nframes, const struct MidiSource *midi);
+
+#endif
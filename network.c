@@ -0,0 +1,141 @@
+/*
+ * tube networks
+ */
+
+#include <string.h>
+#include "network.h"
+
+// the segment at one end of a tube
+static int end_segment(const struct Tube *tube, int end) {
+    return end == END_LEFT ? tube->start : tube->start + tube->n - 1;
+}
+
+int compile_network(const struct Network *network, struct Schedule *schedule) {
+    memset(schedule, 0, sizeof(struct Schedule));
+    schedule->glottis = schedule->lips = -1;
+    int ntubes = network->ntubes;
+    if(ntubes < 1 || ntubes > MAX_TUBES || network->njoins < 0 || network->njoins > MAX_JOINS)
+        return -1;
+
+    // tubes have to have some segments and cant be on top of each other
+    for(int t = 0; t < ntubes; t++) {
+        const struct Tube *a = &network->tubes[t];
+        if(a->n < 1 || a->start < 0)
+            return -1;
+        for(int u = 0; u < t; u++) {
+            const struct Tube *b = &network->tubes[u];
+            if(a->start < b->start + b->n && b->start < a->start + a->n)
+                return -1;
+        }
+    }
+
+    int joined[MAX_TUBES][2] = {{0}};
+    int glued[MAX_TUBES] = {0}; // carries on the run of the tube right before it in memory
+    for(int j = 0; j < network->njoins; j++) {
+        const struct Join *join = &network->joins[j];
+        if(join->nports < 2 || join->nports > MAX_PORTS)
+            return -1;
+        for(int p = 0; p < join->nports; p++) {
+            const struct Port *port = &join->ports[p];
+            if(port->tube < 0 || port->tube >= ntubes || (port->end != END_LEFT && port->end != END_RIGHT))
+                return -1;
+            joined[port->tube][port->end]++;
+        }
+
+        // the end of one tube straight onto the start of the next is just another junction in a run
+        if(join->nports == 2 && join->ports[0].end != join->ports[1].end) {
+            const struct Port *right = join->ports[0].end == END_RIGHT ? &join->ports[0] : &join->ports[1];
+            const struct Port *left = join->ports[0].end == END_LEFT ? &join->ports[0] : &join->ports[1];
+            const struct Tube *a = &network->tubes[right->tube];
+            const struct Tube *b = &network->tubes[left->tube];
+            if(a->start + a->n == b->start && a->fricative == b->fricative) {
+                glued[left->tube] = 1;
+                continue;
+            }
+        }
+
+        struct Split *split = &schedule->splits[schedule->nsplits++];
+        split->nports = join->nports;
+        split->coefficient = join->coefficient;
+        for(int p = 0; p < join->nports; p++) {
+            const struct Port *port = &join->ports[p];
+            split->segment[p] = end_segment(&network->tubes[port->tube], port->end);
+            split->side[p] = port->end;
+        }
+    }
+
+    // every end is either in exactly one join or does something on its own
+    for(int t = 0; t < ntubes; t++) {
+        const struct Tube *tube = &network->tubes[t];
+        for(int e = 0; e < 2; e++) {
+            int type = tube->ends[e];
+            if(joined[t][e] != (type == END_JOINED))
+                return -1;
+            switch(type) {
+                case END_JOINED:
+                    break;
+                case END_GLOTTIS:
+                    if(e != END_LEFT || schedule->glottis >= 0)
+                        return -1;
+                    schedule->glottis = tube->start;
+                    break;
+                case END_LIPS:
+                    if(e != END_RIGHT || schedule->lips >= 0)
+                        return -1;
+                    schedule->lips = end_segment(tube, e);
+                    break;
+                case END_OPEN:
+                    if(e != END_RIGHT)
+                        return -1;
+                    schedule->openings[schedule->nopenings].segment = end_segment(tube, e);
+                    schedule->openings[schedule->nopenings].coefficient = tube->coefficient;
+                    schedule->nopenings++;
+                    break;
+                default:
+                    return -1;
+            }
+        }
+    }
+    if(schedule->glottis < 0 || schedule->lips < 0)
+        return -1;
+
+    // every tube that isnt glued onto another starts a run and takes everything glued after it
+    for(int t = 0; t < ntubes; t++) {
+        if(glued[t])
+            continue;
+        struct Run *run = &schedule->runs[schedule->nruns++];
+        run->start = network->tubes[t].start;
+        run->n = network->tubes[t].n;
+        run->fricative = network->tubes[t].fricative;
+        for(int more = 1; more;) {
+            more = 0;
+            for(int u = 0; u < ntubes; u++) {
+                if(glued[u] && network->tubes[u].start == run->start + run->n) {
+                    run->n += network->tubes[u].n;
+                    more = 1;
+                }
+            }
+        }
+    }
+
+    // in memory order so it streams through the arrays front to back
+    for(int i = 1; i < schedule->nruns; i++)
+        for(int j = i; j > 0 && schedule->runs[j].start < schedule->runs[j-1].start; j--) {
+            struct Run tmp = schedule->runs[j];
+            schedule->runs[j] = schedule->runs[j-1];
+            schedule->runs[j-1] = tmp;
+        }
+    for(int i = 1; i < schedule->nsplits; i++)
+        for(int j = i; j > 0 && schedule->splits[j].segment[0] < schedule->splits[j-1].segment[0]; j--) {
+            struct Split tmp = schedule->splits[j];
+            schedule->splits[j] = schedule->splits[j-1];
+            schedule->splits[j-1] = tmp;
+        }
+    for(int i = 1; i < schedule->nopenings; i++)
+        for(int j = i; j > 0 && schedule->openings[j].segment < schedule->openings[j-1].segment; j--) {
+            struct Opening tmp = schedule->openings[j];
+            schedule->openings[j] = schedule->openings[j-1];
+            schedule->openings[j-1] = tmp;
+        }
+    return 0;
+}
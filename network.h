@@ -0,0 +1,99 @@
+/*
+ * tube networks
+ *
+ * the tract as a handful of tubes joined at their ends by 2 and 3 port junctions
+ * (the velum where the nose branches off, the nostrils, the lips)
+ * compiled once into a flat schedule: contiguous runs of segments the scatter kernels
+ * stream straight through, and a short list of the junctions that dont fit in a run
+ * so however many branches there are the loop over segments never has to check where it is
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+// most tubes and joins a network can have
+#define MAX_TUBES 4
+#define MAX_JOINS 4
+
+// most tubes meeting at one junction
+#define MAX_PORTS 3
+
+// the two ends of a tube
+#define END_LEFT 0 // the glottis end, waves going right start here
+#define END_RIGHT 1 // the lips end, waves going left start here
+
+// what happens at an end that isnt joined to another tube
+#define END_JOINED 0 // nothing, its in a join
+#define END_GLOTTIS 1 // the source comes in and everything reflects (a left end, exactly one)
+#define END_LIPS 2 // radiates out through the lips allpasses (a right end, exactly one)
+#define END_OPEN 3 // radiates straight out like the nostrils (a right end)
+
+// a tube is a run of segments somewhere in the wave arrays
+struct Tube {
+    int start, n; // segments start to start + n - 1
+    int fricative; // the wind noise happens in it
+    int ends[2]; // what happens at END_LEFT and END_RIGHT
+    int coefficient; // where the reflection of an END_OPEN end lives in the coefficients
+};
+
+// one end of a tube
+struct Port {
+    int tube;
+    int end;
+};
+
+// tubes meeting at a junction
+// 2 port joins from the right end of a tube to the left end of the next one in memory
+// just disappear into a run (the coefficient is at the usual place, the second tubes start)
+struct Join {
+    int nports;
+    struct Port ports[MAX_PORTS];
+    int coefficient; // where the weight of every port lives otherwise (nports of them)
+};
+
+struct Network {
+    int ntubes;
+    struct Tube tubes[MAX_TUBES];
+    int njoins;
+    struct Join joins[MAX_JOINS];
+};
+
+// segments the scatter kernel runs straight through (the junctions between them)
+struct Run {
+    int start, n;
+    int fricative;
+};
+
+// a junction of nports tubes
+// port p takes in the wave arriving at a segments end and writes the one leaving it
+// side is the end of the segment the junction is at
+struct Split {
+    int nports;
+    int segment[MAX_PORTS];
+    int side[MAX_PORTS];
+    int coefficient; // weights at coefficient to coefficient + nports - 1
+};
+
+// an open right end of a tube
+struct Opening {
+    int segment;
+    int coefficient; // its reflection
+};
+
+// what to do every sample, everything in the order its laid out in memory
+struct Schedule {
+    int nruns;
+    struct Run runs[MAX_TUBES];
+    int nsplits;
+    struct Split splits[MAX_JOINS];
+    int nopenings;
+    struct Opening openings[MAX_TUBES];
+    int glottis; // the segment the source goes into
+    int lips; // and the one that comes out the lips
+};
+
+// turn a network into a schedule
+// returns 0 on success, -1 if some end is left hanging or theres no single glottis and lips
+int compile_network(const struct Network *network, struct Schedule *schedule);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * frication noise
+ */
+
+#include "noise.h"
+
+static inline uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+void seed_noise(struct Noise *noise, uint32_t seed) {
+    // scramble the seed differently for every lane (splitmix style)
+    // so the lanes dont all say the same thing
+    for(int i = 0; i < NOISE_LANES; i++) {
+        uint32_t x = seed + (i + 1) * 0x9e3779b9u;
+        x = (x ^ (x >> 16)) * 0x85ebca6bu;
+        x = (x ^ (x >> 13)) * 0xc2b2ae35u;
+        x ^= x >> 16;
+        // xorshift gets stuck at 0 forever
+        noise->state[i] = x ? x : 0x6d2b79f5u;
+    }
+}
+
+float next_noise(struct Noise *noise) {
+    noise->state[0] = xorshift32(noise->state[0]);
+    return (int32_t)noise->state[0] * NOISE_SCALE;
+}
+
+void fill_noise(struct Noise *noise, float *out, int n) {
+    uint32_t state[NOISE_LANES];
+    for(int lane = 0; lane < NOISE_LANES; lane++)
+        state[lane] = noise->state[lane];
+
+    // a whole row of lanes at a time
+    int i = 0;
+    for(; i + NOISE_LANES <= n; i += NOISE_LANES) {
+        for(int lane = 0; lane < NOISE_LANES; lane++) {
+            state[lane] = xorshift32(state[lane]);
+            out[i + lane] = (int32_t)state[lane] * NOISE_SCALE;
+        }
+    }
+
+    // and whatever is left over
+    for(int lane = 0; i < n; i++, lane++) {
+        state[lane] = xorshift32(state[lane]);
+        out[i] = (int32_t)state[lane] * NOISE_SCALE;
+    }
+
+    for(int lane = 0; lane < NOISE_LANES; lane++)
+        noise->state[lane] = state[lane];
+}
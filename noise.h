@@ -0,0 +1,37 @@
+/*
+ * frication noise
+ *
+ * a fast little xorshift random number generator
+ * a few independent generators run side by side so filling a buffer vectorizes
+ * and the state lives with the tract instead of hiding in libc like rand()
+ */
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <stdint.h>
+
+// how many generators run side by side
+#define NOISE_LANES 8
+
+// seed used unless told otherwise, so renders are reproducible by default
+#define DEFAULT_NOISE_SEED 1
+
+// scale a random 32 bit integer to -1..1
+#define NOISE_SCALE (1.0f / 2147483648.0f)
+
+struct Noise {
+    uint32_t state[NOISE_LANES];
+};
+
+// start the generators from a seed (same seed = same noise)
+void seed_noise(struct Noise *noise, uint32_t seed);
+
+// a single noise sample between -1 and 1
+float next_noise(struct Noise *noise);
+
+// fill a buffer with noise between -1 and 1
+// (plain floats, the same as the tracts sample_t)
+void fill_noise(struct Noise *noise, float *out, int n);
+
+#endif
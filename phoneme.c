@@ -0,0 +1,164 @@
+/*
+ * phonemes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "phoneme.h"
+#include "tract.h"
+
+// SOME PHONEMES
+struct Phoneme PHONEME_A = { 0.9, 0, 0 };
+struct Phoneme PHONEME_I = { 0.9, 1, 0 };
+struct Phoneme PHONEME_U = { 0, 0, 0.9 };
+struct Phoneme PHONEME_E = { 0.9, 0.5, 0 };
+struct Phoneme PHONEME_O = { 0.9, 0.25, 0.9 };
+struct Phoneme PHONEME_SCHWA = { 0, 0, 0 };
+struct Phoneme PHONEME_UH = { 0.7, 0, 0.6 };
+struct Phoneme PHONEME_AH = { 0.7, 0, 0 };
+struct Phoneme PHONEME_UE = { 0.9, 1, 0.9 };
+struct Phoneme PHONEME_II = { 0.9, 0.75, 0 };
+struct Phoneme PHONEME_OE = { 0, 0, 0.75 };
+
+// the built in map, starting from c2 (i think lol)
+static struct Phoneme *default_phonemes[] = {
+    &PHONEME_A, &PHONEME_I, &PHONEME_U, &PHONEME_E, &PHONEME_O, &PHONEME_SCHWA,
+    &PHONEME_UH, &PHONEME_AH, &PHONEME_UE, &PHONEME_II, &PHONEME_OE,
+};
+#define DEFAULT_FIRST_NOTE 0x24
+
+struct PhonemeMap phoneme_map;
+
+// cos over a quarter turn, and a bit past so the last step can interpolate
+static double cos_table[COS_TABLE_SIZE + 2];
+static int have_cos_table = 0;
+
+int same_phoneme(const struct Phoneme *a, const struct Phoneme *b) {
+    return a->tongue_height == b->tongue_height &&
+           a->tongue_position == b->tongue_position &&
+           a->lips_roundedness == b->lips_roundedness;
+}
+
+// the index of a phoneme in the map, adding it if its new
+// returns -1 if the map is full
+static int map_phoneme(struct PhonemeMap *map, const struct Phoneme *phoneme) {
+    for(int i = 0; i < map->nphonemes; i++)
+        if(same_phoneme(&map->phonemes[i], phoneme))
+            return i;
+    if(map->nphonemes == MAX_PHONEMES)
+        return -1;
+    map->phonemes[map->nphonemes] = *phoneme;
+    return map->nphonemes++;
+}
+
+static void clear_map(struct PhonemeMap *map) {
+    map->nphonemes = 0;
+    for(int i = 0; i < 128; i++)
+        map->notes[i] = -1;
+}
+
+void init_phonemes() {
+    if(!have_cos_table) {
+        for(int i = 0; i < COS_TABLE_SIZE + 2; i++)
+            cos_table[i] = cos((double)i / COS_TABLE_SIZE * M_PI / 2);
+        have_cos_table = 1;
+    }
+
+    if(phoneme_map.nphonemes)
+        return;
+    clear_map(&phoneme_map);
+    int n = sizeof(default_phonemes) / sizeof(*default_phonemes);
+    for(int i = 0; i < n; i++)
+        phoneme_map.notes[DEFAULT_FIRST_NOTE + i] = map_phoneme(&phoneme_map, default_phonemes[i]);
+}
+
+int load_phoneme_map(const char *path) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "could not open phoneme map %s\n", path);
+        return -1;
+    }
+
+    // read into a new map so a bad file doesnt leave half a map behind
+    static struct PhonemeMap map;
+    clear_map(&map);
+    char line[256];
+    int lineno = 0;
+    while(fgets(line, sizeof(line), file)) {
+        lineno++;
+
+        // strip comments
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = 0;
+        char *p = line;
+        while(isspace((unsigned char)*p))
+            p++;
+        if(*p == 0)
+            continue;
+
+        char *end;
+        long note = strtol(p, &end, 0);
+        struct Phoneme phoneme;
+        if(end == p || note < 0 || note > 127 ||
+           sscanf(end, "%lf %lf %lf", &phoneme.tongue_height, &phoneme.tongue_position, &phoneme.lips_roundedness) != 3) {
+            fprintf(stderr, "%s:%i: expected a note and three numbers\n", path, lineno);
+            fclose(file);
+            return -1;
+        }
+        int i = map_phoneme(&map, &phoneme);
+        if(i < 0) {
+            fprintf(stderr, "%s:%i: too many phonemes (max %i)\n", path, lineno, MAX_PHONEMES);
+            fclose(file);
+            return -1;
+        }
+        map.notes[note] = i;
+    }
+    fclose(file);
+
+    if(map.nphonemes == 0) {
+        fprintf(stderr, "no phonemes in %s\n", path);
+        return -1;
+    }
+    phoneme_map = map;
+    return 0;
+}
+
+double tongue_cos(double x) {
+    if(x < 0) x = -x;
+    // nothing the controllers can ask for gets out here, but a map file might
+    if(x > 1)
+        return cos(x * M_PI / 2);
+    double pos = x * COS_TABLE_SIZE;
+    int i = (int)pos;
+    return cos_table[i] + (cos_table[i + 1] - cos_table[i]) * (pos - i);
+}
+
+// approximate shape using cosine
+// position = 0 is all the way back
+// and 1 = all the way up front
+void phoneme_profile(const struct Phoneme *phoneme, double *area, int n) {
+    // get the start and stopping segments
+    int start = TONGUE_BACK * n;
+    int stop = TONGUE_FRONT * n;
+    int ntongue = stop - start;
+
+    for(int i = 0; i < n; i++) {
+        if(i < start) {
+            // throat
+            area[i] = NEUTRAL_Z / (double)THROAT_Z;
+        } else if(i >= stop) {
+            // front of mouth
+            area[i] = 1 - phoneme->lips_roundedness + MIN_AREA;
+        } else {
+            // tongue
+            double unit_pos = (i - start) / (double)(ntongue - 1);
+            double phase = unit_pos - phoneme->tongue_position;
+            double value = tongue_cos(phase) * phoneme->tongue_height;
+            area[i] = 1 - value + MIN_AREA;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * phonemes
+ *
+ * the vowel presets, which midi notes pick them,
+ * and the shape of the tract each one makes
+ */
+
+#ifndef PHONEME_H
+#define PHONEME_H
+
+#include <stdint.h>
+
+// most phonemes a map can have (one per midi note)
+#define MAX_PHONEMES 128
+
+// how many steps the tabulated cosine has between 0 and 1/4 of a turn
+#define COS_TABLE_SIZE 1024
+
+// represents a shape of the mouth to produce a certain sound
+struct Phoneme {
+    // tract shape stuff
+    // vowel space
+    double tongue_height; // closedness
+    double tongue_position; // backness
+    double lips_roundedness;
+};
+
+// SOME PHONEMES
+extern struct Phoneme PHONEME_A;
+extern struct Phoneme PHONEME_I;
+extern struct Phoneme PHONEME_U;
+extern struct Phoneme PHONEME_E;
+extern struct Phoneme PHONEME_O;
+extern struct Phoneme PHONEME_SCHWA;
+extern struct Phoneme PHONEME_UH;
+extern struct Phoneme PHONEME_AH;
+extern struct Phoneme PHONEME_UE;
+extern struct Phoneme PHONEME_II;
+extern struct Phoneme PHONEME_OE;
+
+// which phoneme every note on the phoneme channel picks
+struct PhonemeMap {
+    int nphonemes;
+    struct Phoneme phonemes[MAX_PHONEMES];
+    int notes[128]; // index into phonemes, -1 = the note doesnt pick one
+};
+
+// the map every tract uses
+// the built in presets unless load_phoneme_map() says otherwise
+extern struct PhonemeMap phoneme_map;
+
+// load the map from a file, lines of a note and the three phoneme numbers:
+//   # note  height  position  roundedness
+//   0x24    0.9     0         0
+// do it before building any tracts (they work out the shapes when theyre built)
+// returns 0 on success
+int load_phoneme_map(const char *path);
+
+// build the cosine table and use the built in presets if no map was loaded
+// (init_tract() does this)
+void init_phonemes();
+
+// 1 if two phonemes are exactly the same shape
+int same_phoneme(const struct Phoneme *a, const struct Phoneme *b);
+
+// cos(x * pi / 2) for x between -1 and 1, out of a table
+double tongue_cos(double x);
+
+// fill in the cross sectional area of every segment of an n segment tract
+// in the shape of a phoneme (impedence is NEUTRAL_Z over it)
+void phoneme_profile(const struct Phoneme *phoneme, double *area, int n);
+
+#endif
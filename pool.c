@@ -0,0 +1,158 @@
+/*
+ * worker pool
+ *
+ * workers sleep on a semaphore between cycles (posting one is a single atomic
+ * when nobody is waiting and never blocks the poster) and take jobs by bumping
+ * an atomic counter, the audio thread spins for the stragglers at the end
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "pool.h"
+
+// how long to spin waiting for the other threads before yielding
+#define POOL_SPINS 4096
+
+#define TICKET(njobs, next) ((uint64_t)(njobs) << 32 | (uint32_t)(next))
+#define TICKET_JOBS(t) ((int)((t) >> 32))
+#define TICKET_NEXT(t) ((int)((t) & 0xffffffffu))
+
+// be nice to the other hyperthread while spinning
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// take jobs until there are none left in the batch
+static void work(struct Pool *pool, int worker) {
+    for(;;) {
+        uint64_t t = atomic_fetch_add_explicit(&pool->ticket, 1, memory_order_acq_rel);
+        if(TICKET_NEXT(t) >= TICKET_JOBS(t))
+            return;
+        pool->job(pool->arg, TICKET_NEXT(t), worker);
+        atomic_fetch_add_explicit(&pool->done, 1, memory_order_release);
+    }
+}
+
+static void *worker_thread(void *arg) {
+    struct PoolWorker *worker = arg;
+    struct Pool *pool = worker->pool;
+    for(;;) {
+        sem_wait(&pool->wake);
+        if(atomic_load_explicit(&pool->quit, memory_order_acquire))
+            return NULL;
+        work(pool, worker->index);
+    }
+}
+
+// pin a thread to the nth cpu this process is allowed on
+static void pin_thread(pthread_t thread, int n) {
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed))
+        return;
+    int ncpus = CPU_COUNT(&allowed);
+    if(ncpus < 2)
+        return;
+    n %= ncpus;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &allowed))
+            continue;
+        if(n-- == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(thread, sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+int start_pool(struct Pool *pool, int nthreads, int priority) {
+    // more threads than cpus just get in each others way
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(ncpus > 0 && nthreads > ncpus - 1)
+        nthreads = ncpus - 1;
+    if(nthreads > MAX_POOL_THREADS)
+        nthreads = MAX_POOL_THREADS;
+    pool->nthreads = 0;
+    atomic_store(&pool->quit, 0);
+    atomic_store(&pool->ticket, TICKET(0, 0));
+    atomic_store(&pool->done, 0);
+    if(sem_init(&pool->wake, 0, 0))
+        return -1;
+
+    for(int i = 0; i < nthreads; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if(priority > 0) {
+            struct sched_param param = { .sched_priority = priority };
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &param);
+        }
+
+        struct PoolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i + 1;
+        int err = pthread_create(&pool->threads[i], &attr, worker_thread, worker);
+        if(err && priority > 0) {
+            // not allowed to go realtime, better slow than nothing
+            if(i == 0)
+                fprintf(stderr, "couldnt start realtime worker threads (%s), using normal ones\n", strerror(err));
+            priority = 0;
+            pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+            err = pthread_create(&pool->threads[i], &attr, worker_thread, worker);
+        }
+        pthread_attr_destroy(&attr);
+        if(err) {
+            fprintf(stderr, "couldnt start worker thread: %s\n", strerror(err));
+            stop_pool(pool);
+            return -1;
+        }
+
+        // the audio thread is usually on the first cpu so leave it be
+        pin_thread(pool->threads[i], i + 1);
+        pool->nthreads++;
+    }
+    return 0;
+}
+
+void run_pool(struct Pool *pool, pool_job job, void *arg, int njobs) {
+    pool->job = job;
+    pool->arg = arg;
+    atomic_store_explicit(&pool->done, 0, memory_order_relaxed);
+    // publishes the job and arg too
+    atomic_store_explicit(&pool->ticket, TICKET(njobs, 0), memory_order_release);
+
+    // wake up as many as could have something to do
+    int wake = njobs - 1 < pool->nthreads ? njobs - 1 : pool->nthreads;
+    for(int i = 0; i < wake; i++)
+        sem_post(&pool->wake);
+
+    work(pool, 0);
+
+    // wait for the stragglers
+    // (every now and then let them have the cpu in case theyre stuck behind us)
+    for(int spins = 1; atomic_load_explicit(&pool->done, memory_order_acquire) < njobs; spins++) {
+        cpu_relax();
+        if(spins % POOL_SPINS == 0)
+            sched_yield();
+    }
+}
+
+void stop_pool(struct Pool *pool) {
+    atomic_store_explicit(&pool->quit, 1, memory_order_release);
+    for(int i = 0; i < pool->nthreads; i++)
+        sem_post(&pool->wake);
+    for(int i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pool->nthreads = 0;
+    sem_destroy(&pool->wake);
+}
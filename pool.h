@@ -0,0 +1,59 @@
+/*
+ * worker pool
+ *
+ * a few threads that sit waiting to help the audio thread out
+ * every cycle the audio thread hands out a batch of jobs, helps with them itself
+ * and waits for the last one to finish, no locks anywhere on the way
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+// most threads a pool can have
+#define MAX_POOL_THREADS 64
+
+// does job number job, worker says which thread (0 = the one calling run_pool())
+typedef void (*pool_job)(void *arg, int job, int worker);
+
+struct Pool;
+
+// what a worker thread needs to know about itself
+struct PoolWorker {
+    struct Pool *pool;
+    int index; // 1 and up, 0 is the audio thread
+};
+
+struct Pool {
+    int nthreads; // not counting the audio thread
+    pthread_t threads[MAX_POOL_THREADS];
+    struct PoolWorker workers[MAX_POOL_THREADS];
+    sem_t wake; // posted once for every worker thats needed
+    atomic_int quit;
+
+    // the batch being worked on
+    pool_job job;
+    void *arg;
+    // jobs in the batch in the top half, next one to hand out in the bottom half
+    // both in one word so a thread always sees a count and an index from the same batch
+    _Atomic uint64_t ticket;
+    atomic_int done; // jobs finished
+};
+
+// start nthreads workers (fewer if there arent that many spare cpus)
+// priority > 0 runs them SCHED_FIFO at that priority (falls back to normal if not allowed)
+// every worker is pinned to its own cpu
+// returns 0 on success
+int start_pool(struct Pool *pool, int nthreads, int priority);
+
+// run jobs 0..njobs-1 spread across the workers and the calling thread
+// returns once theyre all done
+void run_pool(struct Pool *pool, pool_job job, void *arg, int njobs);
+
+void stop_pool(struct Pool *pool);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * recording
+ *
+ * the audio thread only ever moves head and the writer only ever moves tail
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "record.h"
+
+void record_frames(struct Recorder *recorder, const sample_t *frames, int n) {
+    unsigned long h = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+    unsigned long room = RECORD_RING - (h - atomic_load_explicit(&recorder->tail, memory_order_acquire));
+    if((unsigned long)n > room) {
+        atomic_fetch_add_explicit(&recorder->dropped, n - room, memory_order_relaxed);
+        n = room;
+    }
+
+    // in up to 2 pieces if it wraps round the end
+    unsigned long at = h & (RECORD_RING - 1);
+    unsigned long first = RECORD_RING - at < (unsigned long)n ? RECORD_RING - at : (unsigned long)n;
+    memcpy(recorder->ring + at, frames, sizeof(sample_t) * first);
+    memcpy(recorder->ring, frames + first, sizeof(sample_t) * (n - first));
+    atomic_store_explicit(&recorder->head, h + n, memory_order_release);
+}
+
+unsigned long record_dropped(struct Recorder *recorder) {
+    return atomic_load_explicit(&recorder->dropped, memory_order_relaxed);
+}
+
+static void write_frames(struct Recorder *recorder, const sample_t *frames, size_t n) {
+    if(recorder->is_wav && n > WAV_MAX_FRAMES - recorder->wav.frames) {
+        if(!recorder->full)
+            fprintf(stderr, "%s is as long as a wav file can be, not recording any more\n", recorder->path);
+        recorder->full = 1;
+        n = WAV_MAX_FRAMES - recorder->wav.frames;
+    }
+    if(n == 0)
+        return;
+    size_t written = recorder->is_wav ? wav_write(&recorder->wav, frames, n) : fwrite(frames, sizeof(sample_t), n, recorder->file);
+    if(written != n)
+        fprintf(stderr, "couldnt write to %s\n", recorder->path);
+}
+
+// write out everything thats in the ring, returns how many frames that was
+static unsigned long drain_recording(struct Recorder *recorder) {
+    unsigned long h = atomic_load_explicit(&recorder->head, memory_order_acquire);
+    unsigned long t = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+    if(h == t)
+        return 0;
+    unsigned long at = t & (RECORD_RING - 1);
+    unsigned long n = h - t;
+    unsigned long first = RECORD_RING - at < n ? RECORD_RING - at : n;
+    write_frames(recorder, recorder->ring + at, first);
+    write_frames(recorder, recorder->ring, n - first);
+    atomic_store_explicit(&recorder->tail, h, memory_order_release);
+    return n;
+}
+
+static void *record_main(void *arg) {
+    struct Recorder *recorder = arg;
+    unsigned long reported = 0;
+    unsigned long unsynced = 0; // frames written since the last flush
+    int polls = 0; // and how many polls ago that was
+    struct timespec interval = { 0, RECORD_POLL * 1000000L };
+    while(!atomic_load_explicit(&recorder->quit, memory_order_acquire)) {
+        unsynced += drain_recording(recorder);
+        polls++;
+        // keep the header up to date so the file is good even if we get killed
+        // but not every poll, that would chop the writes up small
+        if(unsynced >= RECORD_BUFFER / sizeof(sample_t) || (unsynced && polls >= RECORD_SYNC * 1000 / RECORD_POLL)) {
+            fflush(recorder->file);
+            if(recorder->is_wav)
+                wav_close_write(&recorder->wav);
+            unsynced = 0;
+            polls = 0;
+        }
+        unsigned long dropped = record_dropped(recorder);
+        if(dropped != reported) {
+            fprintf(stderr, "recording fell behind, dropped %lu frames (%lu so far)\n", dropped - reported, dropped);
+            reported = dropped;
+        }
+        nanosleep(&interval, NULL);
+    }
+    drain_recording(recorder);
+    return NULL;
+}
+
+int start_recording(struct Recorder *recorder, const char *path, int rate) {
+    memset(recorder, 0, sizeof(struct Recorder));
+    recorder->path = path;
+    size_t n = strlen(path);
+    recorder->is_wav = n >= 4 && !strcasecmp(path + n - 4, ".wav");
+
+    recorder->file = fopen(path, "wb");
+    if(recorder->file == NULL)
+        return -1;
+    recorder->buffer = malloc(RECORD_BUFFER);
+    if(recorder->buffer == NULL) {
+        fclose(recorder->file);
+        return -1;
+    }
+    setvbuf(recorder->file, recorder->buffer, _IOFBF, RECORD_BUFFER);
+    if(recorder->is_wav && wav_open_write(&recorder->wav, recorder->file, rate)) {
+        fclose(recorder->file);
+        free(recorder->buffer);
+        return -1;
+    }
+
+    // touch every page now so the audio thread never takes a page fault on it
+    recorder->ring = malloc(sizeof(sample_t) * RECORD_RING);
+    if(recorder->ring == NULL) {
+        fclose(recorder->file);
+        free(recorder->buffer);
+        return -1;
+    }
+    memset(recorder->ring, 0, sizeof(sample_t) * RECORD_RING);
+
+    if(pthread_create(&recorder->thread, NULL, record_main, recorder)) {
+        free(recorder->ring);
+        fclose(recorder->file);
+        free(recorder->buffer);
+        return -1;
+    }
+    recorder->running = 1;
+    return 0;
+}
+
+void stop_recording(struct Recorder *recorder) {
+    if(!recorder->running)
+        return;
+    atomic_store_explicit(&recorder->quit, 1, memory_order_release);
+    pthread_join(recorder->thread, NULL);
+    recorder->running = 0;
+    if(recorder->is_wav)
+        wav_close_write(&recorder->wav);
+    fclose(recorder->file);
+    free(recorder->buffer);
+    free(recorder->ring);
+    if(record_dropped(recorder))
+        fprintf(stderr, "recording dropped %lu frames in all\n", record_dropped(recorder));
+}
@@ -0,0 +1,68 @@
+/*
+ * recording
+ *
+ * the audio thread cant touch files (the disk can make it wait for ages)
+ * so it copies what it sang into a big lock-free ring buffer
+ * and a normal thread writes that out to a .wav or raw file in big chunks
+ * a wav stops at WAV_MAX_FRAMES (about 6 hours at 48khz), raw files just keep going
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "tract.h"
+#include "wav.h"
+
+// how many frames the ring holds (a power of 2, about 20 seconds at 48khz)
+// thats how long the disk can stall before anything gets dropped
+#define RECORD_RING (1 << 20)
+
+// how often the writer looks for new frames (milliseconds)
+#define RECORD_POLL 50
+
+// the file buffer, so the writes come out big and whole pages
+#define RECORD_BUFFER (1 << 20)
+
+// the writer only flushes (and patches the wav header) once a whole buffer is waiting
+// or at the latest this often (seconds), so if it gets killed thats about all thats lost
+#define RECORD_SYNC 5
+
+struct Recorder {
+    const char *path;
+    FILE *file;
+    char *buffer; // RECORD_BUFFER of it (setvbuf() ignores the size if it gets to pick the buffer)
+    int is_wav;
+    struct Wav wav;
+    int full; // the wav is as long as a header can count, the rest gets thrown away
+
+    // single producer single consumer, like the log
+    sample_t *ring;
+    atomic_ulong head; // frames in
+    atomic_ulong tail; // frames written
+    atomic_ulong dropped; // frames that didnt fit because the disk was behind
+
+    pthread_t thread;
+    int running;
+    atomic_int quit;
+};
+
+// open path (.wav is a 32 bit float wav, anything else raw 32 bit float mono)
+// allocate the ring and start the writer thread
+// returns 0 on success
+int start_recording(struct Recorder *recorder, const char *path, int rate);
+
+// copy n frames into the ring (only the audio thread, never blocks or allocates)
+// if theres no room for all of them the ones that dont fit get dropped and counted
+void record_frames(struct Recorder *recorder, const sample_t *frames, int n);
+
+// frames dropped so far
+unsigned long record_dropped(struct Recorder *recorder);
+
+// write whatever is left, finish the file and stop the thread
+void stop_recording(struct Recorder *recorder);
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * reference tract
+ *
+ * a copy of run_tract() as it was when the faster paths were checked against it
+ * with its own copies of the little helpers so changing those doesnt change this
+ * (the crossfade, the phoneme shapes and the nose too, only tongue_cos() and the noise layout are shared)
+ * everything is in double except the waves themselves
+ */
+
+#include <math.h>
+
+#include "reference.h"
+
+static double reference_reflection(double source_z, double target_z) {
+    return (target_z - source_z) / (target_z + source_z);
+}
+
+static sample_t reference_allpass(sample_t a, sample_t *state, sample_t x) {
+    sample_t y = a * x + state[0] - a * state[1];
+    state[0] = x;
+    state[1] = y;
+    return y;
+}
+
+static void reference_swap(struct Tract *tract) {
+    if(tract->segments_front == tract->buffer1) {
+        tract->segments_front = tract->buffer2;
+        tract->segments_back = tract->buffer1;
+    } else {
+        tract->segments_front = tract->buffer1;
+        tract->segments_back = tract->buffer2;
+    }
+    sample_t *tmp = tract->left_front;
+    tract->left_front = tract->left_back;
+    tract->left_back = tmp;
+    tmp = tract->right_front;
+    tract->right_front = tract->right_back;
+    tract->right_back = tmp;
+}
+
+static int reference_same_phoneme(const struct Phoneme *a, const struct Phoneme *b) {
+    return a->tongue_height == b->tongue_height &&
+           a->tongue_position == b->tongue_position &&
+           a->lips_roundedness == b->lips_roundedness;
+}
+
+// the area of every segment for a phoneme, the throat then the tongue then the lips
+static void reference_profile(const struct Phoneme *phoneme, double *area, int n) {
+    int start = TONGUE_BACK * n;
+    int stop = TONGUE_FRONT * n;
+    int ntongue = stop - start;
+    for(int i = 0; i < n; i++) {
+        if(i < start) {
+            area[i] = NEUTRAL_Z / (double)THROAT_Z;
+        } else if(i >= stop) {
+            area[i] = 1 - phoneme->lips_roundedness + MIN_AREA;
+        } else {
+            double unit_pos = (i - start) / (double)(ntongue - 1);
+            double value = tongue_cos(unit_pos - phoneme->tongue_position) * phoneme->tongue_height;
+            area[i] = 1 - value + MIN_AREA;
+        }
+    }
+}
+
+// start crossfading from wherever the shape is now to the target phoneme
+// always working the target out from scratch (in profile_free) instead of using the precomputed ones
+static void reference_retarget(struct Tract *tract) {
+    for(int i = 0; i < tract->nsegments; i++)
+        tract->profile_from[i] = tract->profile_from[i] * (1 - tract->fade) + tract->profile_to[i] * tract->fade;
+    tract->to_phoneme = *tract->target_phoneme;
+    reference_profile(&tract->to_phoneme, tract->profile_free, tract->nsegments);
+    tract->profile_to = tract->profile_free;
+    tract->fade = 0;
+}
+
+// crossfade one sample further toward the target phoneme
+static void reference_crossfade(struct Tract *tract) {
+    if(!tract->interpolation)
+        return;
+    if(!reference_same_phoneme(tract->target_phoneme, &tract->to_phoneme))
+        reference_retarget(tract);
+    else if(tract->fade == 1)
+        return;
+    tract->fade = 1 - (1 - tract->fade) * (1 - tract->interpolation_drag);
+    if(1 - tract->fade <= PHONEME_EPSILON)
+        tract->fade = 1;
+
+    // the walls head for wherever the crossfade has got to
+    for(int i = 0; i < tract->nsegments; i++) {
+        double area = tract->profile_from[i] * (1 - tract->fade) + tract->profile_to[i] * tract->fade;
+        tract->segments_front[i].target_z = NEUTRAL_Z / area;
+    }
+}
+
+// where the nose branches off, the segment just past the throat
+static int reference_velum_segment(const struct Tract *tract) {
+    int v = (int)(VELUM_POSITION * tract->nsegments + 0.5);
+    if(v < 1) v = 1;
+    if(v > tract->nsegments - 1) v = tract->nsegments - 1;
+    return v;
+}
+
+// the nose never moves, the way in is as wide as the velum lets it be
+// then it opens up into the nasal cavity and narrows again at the nostrils
+static double reference_nose_z(const struct Tract *tract, int i) {
+    double area;
+    if(i == 0) {
+        area = tract->velum * NOSE_PORT_AREA + MIN_AREA;
+    } else {
+        double x = (double)i / (tract->nose_length - 1);
+        area = 0.4 + 0.6 * sin(M_PI * x);
+    }
+    return NEUTRAL_Z / area;
+}
+
+// the waves in the nose for a sample, the nostrils let some out and reflect the rest
+// the way in is reference_velum()s, which has to come after this clears the nose
+static sample_t reference_nose(struct Tract *tract) {
+    int start = tract->nose_start;
+    int c = start + tract->nose_length;
+    double atten = 1 - tract->damping;
+    for(int j = start; j < c; j++) {
+        tract->left_back[j] = 0;
+        tract->right_back[j] = 0;
+    }
+    for(int j = start + 1; j < c; j++) {
+        double left_z = reference_nose_z(tract, j - 1 - start);
+        double right_z = reference_nose_z(tract, j - start);
+        sample_t reflection = tract->right_front[j-1] * reference_reflection(left_z, right_z);
+        tract->right_back[j] += tract->right_front[j-1] - reflection;
+        tract->left_back[j-1] += reflection * atten;
+        reflection = tract->left_front[j] * reference_reflection(right_z, left_z);
+        tract->left_back[j-1] += tract->left_front[j] - reflection;
+        tract->right_back[j] += reflection * atten;
+    }
+    sample_t x = tract->right_front[c-1];
+    sample_t back = x * reference_reflection(reference_nose_z(tract, tract->nose_length - 1), DRAIN_Z);
+    tract->left_back[c-1] += back * atten;
+    return x - back;
+}
+
+// the velum, where the throat, the mouth and the nose all meet
+// everything arriving gets shared out between them, the wider ones getting more
+static void reference_velum(struct Tract *tract, int v) {
+    int segment[3] = { v - 1, v, tract->nose_start };
+    double z[3] = { tract->segments_front[v-1].z, tract->segments_front[v].z, reference_nose_z(tract, 0) };
+    sample_t x[3] = { tract->right_front[v-1], tract->left_front[v], tract->left_front[tract->nose_start] };
+    double total = 1 / z[0] + 1 / z[1] + 1 / z[2];
+    double sum = x[0] + x[1] + x[2];
+    for(int p = 0; p < 3; p++) {
+        double w = 2 / z[p] / total;
+        sample_t y = w * (sum - x[p]) + (1 - tract->damping) * (w - 1) * x[p];
+        if(p == 0)
+            tract->left_back[segment[p]] += y;
+        else
+            tract->right_back[segment[p]] += y;
+    }
+}
+
+sample_t run_reference(struct Tract *tract, sample_t glottal_source) {
+    sample_t drain = 0;
+    int n = tract->nsegments;
+    // with the velum open the junction between the throat and the mouth is the velum one instead
+    int v = tract->velum > 0 && n >= 2 ? reference_velum_segment(tract) : -1;
+
+    // the noise comes a row per sample in the same order the block paths use it
+    // so the engines can be held to the same waveform here too
+    sample_t *noise_left = tract->noise_buffer;
+    sample_t *noise_right = noise_left + padded_length(n);
+    if(tract->frication)
+        fill_noise(&tract->noise, tract->noise_buffer, padded_length(n) * 2);
+
+    // the walls move toward their targets
+    for(int i = 0; i < n; i++) {
+        struct Segment *old = &(tract->segments_front[i]);
+        struct Segment *new = &(tract->segments_back[i]);
+        new->target_z = old->target_z;
+        new->rigidity = old->rigidity;
+        tract->left_back[i] = 0;
+        tract->right_back[i] = 0;
+
+        double old_area = 1 / old->z;
+        double target_area = 1 / new->target_z;
+        double delta = target_area - old_area;
+        double new_area = old_area + delta * PHYSICAL_DAMPING;
+        if(new_area < 0) new_area = MIN_AREA;
+        new->z = 1 / new_area;
+    }
+
+    for(int i = 0; i < n; i++) {
+        struct Segment *old = &(tract->segments_front[i]);
+        struct Segment *new = &(tract->segments_back[i]);
+        double area = 1 / new->z;
+
+        // waves going right, the glottis at the start
+        if(i == 0) {
+            double gamma = 1 - reference_reflection(DRAIN_Z, old->z);
+            tract->right_back[i] += tract->left_front[i] * (1 - tract->damping) + glottal_source * gamma + tract->diaphram_pressure;
+        } else if(i != v) {
+            struct Segment *old_left = &(tract->segments_front[i-1]);
+            double gamma = reference_reflection(old_left->z, old->z);
+            sample_t reflection = tract->right_front[i-1] * gamma;
+            tract->right_back[i] += tract->right_front[i-1] - reflection;
+            tract->left_back[i-1] += reflection * (1 - tract->damping);
+            if(tract->frication) {
+                double velocity = reflection;
+                if(velocity < 0) velocity = 0;
+                tract->left_back[i-1] += tract->frication * velocity * noise_left[i];
+            }
+            area += reflection * (1 - old->rigidity);
+        }
+
+        // waves going left, the lips (and the allpasses) at the end
+        if(i == n - 1) {
+            double gamma = reference_reflection(old->z, DRAIN_Z);
+            tract->lips_allpass = tract->lips_allpass_target;
+            sample_t out_wave = reference_allpass(tract->lips_allpass, tract->lips_state, tract->right_front[i]);
+            sample_t reflection = out_wave * gamma;
+            drain = out_wave - reflection;
+            tract->left_back[i] += reference_allpass(tract->lips_allpass, tract->lips_state + 2, reflection * (1 - tract->damping));
+            area += reflection * (1 - old->rigidity);
+        } else if(i != v - 1) {
+            struct Segment *old_right = &(tract->segments_front[i+1]);
+            double gamma = reference_reflection(old_right->z, old->z);
+            sample_t reflection = tract->left_front[i+1] * gamma;
+            tract->left_back[i] += tract->left_front[i+1] - reflection;
+            tract->right_back[i+1] += reflection * (1 - tract->damping);
+            if(tract->frication) {
+                double velocity = reflection;
+                if(velocity < 0) velocity = 0;
+                tract->right_back[i+1] += tract->frication * velocity * noise_right[i+1];
+            }
+            area += reflection * (1 - old->rigidity);
+        }
+
+        if(area < 0) area = MIN_AREA;
+        new->z = 1 / area;
+    }
+
+    // (the walls there are all rigid so theres no squashing them)
+    if(v >= 0) {
+        drain += reference_nose(tract);
+        reference_velum(tract, v);
+    }
+
+    reference_swap(tract);
+    reference_crossfade(tract);
+    return drain;
+}
@@ -0,0 +1,18 @@
+/*
+ * reference tract
+ *
+ * the original per sample algorithm, frozen
+ * everything faster (the block path, the simd kernels, gangs, threads...) gets checked
+ * against this (see verify.c), so leave it alone even when run_tract() changes
+ */
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include "tract.h"
+
+// run a tract built the usual way (setup_tract()) for a single sample the reference way
+// the nose too if the velums open (unlike run_tract())
+sample_t run_reference(struct Tract *tract, sample_t glottal_source);
+
+#endif
@@ -0,0 +1,794 @@
+/*
+ * nancealoid-render
+ *
+ * runs the vocal tract offline without jack
+ * reads a glottal source and a timestamped control stream (midi or control events)
+ * and writes what comes out of the mouth to a file as fast as the cpu allows
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "tract.h"
+#include "voice.h"
+#include "rtlog.h"
+#include "wav.h"
+
+// default rate for raw sources that dont say what they are
+#define DEFAULT_RATE 48000
+
+// how many frames to render at a time
+#define RENDER_BLOCK 1024
+
+// max bytes in one midi message of the control stream
+#define MAX_MIDI_SIZE 3
+
+// how long the chunks of a parallel render are (seconds)
+// fixed rather than worked out from the number of threads so a score always comes out the same
+#define RENDER_CHUNK 30
+
+// how far either side of where a chunk would end to look for somewhere quiet to end it (seconds)
+#define RENDER_SEARCH 1
+
+// the steps its looked for in and how much source either side of a spot counts toward how loud it is (frames)
+#define QUIET_STEP 256
+
+// how much of the score before its chunk every thread runs first so the tract is already going (seconds)
+#define RENDER_WARMUP 0.5
+
+// how long neighbouring chunks crossfade for (frames)
+#define RENDER_FADE 256
+
+// most words on one line of a batch
+#define MAX_BATCH_ARGS 64
+
+// the options that go with a single render (on the command line or a line of a batch)
+#define RENDER_OPTIONS "r:c:l:t:s:v:j:p:R:g"
+
+// a midi message or a control event scheduled at a particular frame
+struct Event {
+    long frame;
+    int order; // position in the file so events at the same time stay in order
+    size_t size; // 0 = its a control event
+    uint8_t buffer[MAX_MIDI_SIZE];
+    struct ControlEvent control;
+};
+
+// everything about one render
+struct Render {
+    const char *source_path; // NULL = just the built in glottis
+    const char *output_path;
+    const char *control_path;
+    int sample_rate;
+    double length;
+    double tail;
+    long seed;
+    int nvoices;
+    int nthreads;
+    int period;
+    int inside_rate;
+    int glottis;
+    int source_is_wav;
+    int output_is_wav;
+
+    // for chunked renders (see plan_render())
+    struct Event *events;
+    size_t nevents;
+    struct Wav output_wav; // the header
+    long frames; // how long it comes out
+    int nchunks; // 0 = it cant be cut up, its done in one go
+    long *bounds; // chunk k is bounds[k] up to bounds[k+1]
+    sample_t *seams; // where each chunk meets the next, RENDER_FADE of the end of one then of the start of the other
+};
+
+void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options] <source> <output>\n"
+        "       %s -g [options] <output>\n"
+        "       %s -b batch [-P threads]\n"
+        "\n"
+        "  <source>   glottal source, a .wav file or raw 32 bit float mono (- for stdin)\n"
+        "             (with -g its added to the built in one, without a source\n"
+        "             it renders -t seconds of just the built in one)\n"
+        "  <output>   .wav file (32 bit float), otherwise raw 32 bit float mono (- for stdout)\n"
+        "\n"
+        "  -r rate    sample rate of a raw source (default %i, wav files use their own)\n"
+        "  -c file    timestamped control stream\n"
+        "  -l cm      initial tract length (default %.1f)\n"
+        "  -t secs    render this much silence after the source ends so the tract rings out\n"
+        "  -s seed    seed for the frication noise (same seed = same render)\n"
+        "  -v voices  how many notes can sound at once (default 1, max %i)\n"
+        "  -j threads extra threads to run the voices on (default 0)\n"
+        "  -p samples how often the tract shape is updated (default %i, %i to %i)\n"
+        "  -m file    which phoneme every note on channel 10 picks (see phonemes.txt)\n"
+        "  -R rate    run the tracts at this rate and resample to and from the source rate\n"
+        "  -g         sing the notes with the built in glottal source\n"
+        "  -V level   how much to log: %i nothing, %i just the important stuff, %i every midi event\n"
+        "  -P threads cut the render into %i second chunks and render them on this many threads\n"
+        "             (instead of -j, the chunks start running a little early and crossfade\n"
+        "             into each other in quiet spots, so its close to but not exactly the same)\n"
+        "  -b file    a batch of renders, a line each with the options above and the paths\n"
+        "             (-m -V and -P apply to all of them, with -P they all share the threads)\n"
+        "\n"
+        "each line of the control stream is a time in seconds followed by the\n"
+        "bytes of a midi message in hex, or the name of a control and its value\n"
+        "(phoneme height position roundedness, length cm, pressure, damping, drag, velum)\n"
+        "for example:\n"
+        "\n"
+        "  # open up and breathe out\n"
+        "  0.0  99 24 7f\n"
+        "  0.5  b0 1a 7f\n"
+        "  1.0  phoneme 0.9 0.1 0\n"
+        "  1.5  length 15.5\n"
+        "\n", name, name, name, DEFAULT_RATE, TRACT_LENGTH, MAX_VOICES, CONTROL_PERIOD, MIN_CONTROL_PERIOD, MAX_CONTROL_PERIOD, LOG_QUIET, LOG_INFO, LOG_EVENTS, RENDER_CHUNK);
+    exit(1);
+}
+
+int ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && !strcasecmp(s + n - m, suffix);
+}
+
+int compare_events(const void *a, const void *b) {
+    const struct Event *x = a, *y = b;
+    if(x->frame != y->frame)
+        return x->frame < y->frame ? -1 : 1;
+    return x->order - y->order;
+}
+
+// load the whole control stream and sort it by time
+struct Event *load_events(const char *path, int sample_rate, size_t *count) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "could not open control stream %s\n", path);
+        exit(1);
+    }
+
+    size_t n = 0, capacity = 256;
+    struct Event *events = malloc(sizeof(struct Event) * capacity);
+    char line[256];
+    int lineno = 0;
+
+    while(fgets(line, sizeof(line), file)) {
+        lineno++;
+
+        // strip comments
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = 0;
+
+        char *p = line;
+        while(isspace((unsigned char)*p))
+            p++;
+        if(*p == 0)
+            continue;
+
+        char *end;
+        double time = strtod(p, &end);
+        if(end == p || !isfinite(time) || time < 0) {
+            fprintf(stderr, "%s:%i: bad time\n", path, lineno);
+            exit(1);
+        }
+        p = end;
+
+        struct Event e = { (long)(time * sample_rate + 0.5), lineno, 0 };
+        int control = !parse_control(p, &e.control); // no midi message looks like one of these
+        e.control.time = e.frame;
+        while(!control) {
+            unsigned long byte = strtoul(p, &end, 16);
+            if(end == p)
+                break;
+            if(byte > 0xff || e.size == MAX_MIDI_SIZE) {
+                fprintf(stderr, "%s:%i: bad midi message\n", path, lineno);
+                exit(1);
+            }
+            e.buffer[e.size++] = byte;
+            p = end;
+        }
+        if(e.size == 0 && !control) {
+            fprintf(stderr, "%s:%i: missing midi message or control event\n", path, lineno);
+            exit(1);
+        }
+
+        if(n == capacity) {
+            capacity *= 2;
+            events = realloc(events, sizeof(struct Event) * capacity);
+        }
+        events[n++] = e;
+    }
+    fclose(file);
+
+    qsort(events, n, sizeof(struct Event), compare_events);
+    *count = n;
+    return events;
+}
+
+// apply a single event from the control stream
+static void apply_event(struct Choir *choir, const struct Event *event) {
+    if(event->size)
+        choir_midi(choir, event->buffer, event->size);
+    else
+        choir_control(choir, &event->control);
+}
+
+// run the choir over n frames starting at frame, applying every event on exactly the frame its for
+static void render_block(struct Choir *choir, const struct Event *events, size_t nevents, size_t *next, long frame,
+                         const sample_t *in, sample_t *out, size_t n) {
+    size_t done = 0;
+    while(done < n) {
+        // apply everything thats due by now
+        while(*next < nevents && events[*next].frame <= frame) {
+            apply_event(choir, &events[*next]);
+            (*next)++;
+        }
+
+        // then render up to the next event
+        size_t span = n - done;
+        if(*next < nevents && events[*next].frame - frame < span)
+            span = events[*next].frame - frame;
+        run_choir(choir, in + done, out + done, span);
+        done += span;
+        frame += span;
+    }
+}
+
+// everything the command line (or a line of a batch) can say about a render
+static int render_option(struct Render *render, int opt, const char *arg) {
+    switch(opt) {
+        case 'r': render->sample_rate = atoi(arg); break;
+        case 'c': render->control_path = arg; break;
+        case 'l': render->length = atof(arg); break;
+        case 't': render->tail = atof(arg); break;
+        case 's': render->seed = strtoul(arg, NULL, 0); break;
+        case 'v': render->nvoices = atoi(arg); break;
+        case 'j': render->nthreads = atoi(arg); break;
+        case 'p': render->period = atoi(arg); break;
+        case 'R': render->inside_rate = atoi(arg); break;
+        case 'g': render->glottis = 1; break;
+        default: return -1;
+    }
+    return 0;
+}
+
+static void default_render(struct Render *render) {
+    memset(render, 0, sizeof(struct Render));
+    render->sample_rate = DEFAULT_RATE;
+    render->length = TRACT_LENGTH;
+    render->seed = -1;
+    render->nvoices = 1;
+    render->period = CONTROL_PERIOD;
+}
+
+// take the paths after the options, returns 0 if the whole render makes sense
+static int finish_options(struct Render *render, int npaths, char **paths) {
+    if(!(npaths == 2 || (npaths == 1 && render->glottis)))
+        return -1;
+    render->source_path = npaths == 2 ? paths[0] : NULL;
+    render->output_path = paths[npaths - 1];
+    if(render->sample_rate <= 0 || render->nvoices < 1 || render->nvoices > MAX_VOICES ||
+       render->nthreads < 0 || render->nthreads > MAX_POOL_THREADS ||
+       render->period < MIN_CONTROL_PERIOD || render->period > MAX_CONTROL_PERIOD || render->inside_rate < 0)
+        return -1;
+    return 0;
+}
+
+// load a batch file, one render a line with the same options and paths as the command line
+struct Render *load_batch(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "could not open batch %s\n", path);
+        exit(1);
+    }
+
+    int n = 0, capacity = 16;
+    struct Render *renders = malloc(sizeof(struct Render) * capacity);
+    char line[1024];
+    int lineno = 0;
+    while(fgets(line, sizeof(line), file)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = 0;
+
+        // split it up like a shell would (without any quoting), the render keeps pointers into it
+        char *copy = strdup(line);
+        char *argv[MAX_BATCH_ARGS + 1];
+        int argc = 0;
+        argv[argc++] = "batch";
+        for(char *word = strtok(copy, " \t\r\n"); word; word = strtok(NULL, " \t\r\n")) {
+            if(argc == MAX_BATCH_ARGS) {
+                fprintf(stderr, "%s:%i: too many arguments\n", path, lineno);
+                exit(1);
+            }
+            argv[argc++] = word;
+        }
+        argv[argc] = NULL;
+        if(argc == 1) {
+            free(copy);
+            continue;
+        }
+
+        if(n == capacity) {
+            capacity *= 2;
+            renders = realloc(renders, sizeof(struct Render) * capacity);
+        }
+        struct Render *render = &renders[n];
+        default_render(render);
+        optind = 0; // start getopt over (glibc)
+        int opt;
+        while((opt = getopt(argc, argv, RENDER_OPTIONS)) != -1)
+            if(render_option(render, opt, optarg)) {
+                fprintf(stderr, "%s:%i: bad option\n", path, lineno);
+                exit(1);
+            }
+        if(finish_options(render, argc - optind, argv + optind)) {
+            fprintf(stderr, "%s:%i: bad render\n", path, lineno);
+            exit(1);
+        }
+
+        // theyre all going at once so they cant share stdin or stdout
+        if(!strcmp(render->output_path, "-") || (render->source_path && !strcmp(render->source_path, "-"))) {
+            fprintf(stderr, "%s:%i: renders in a batch need real files\n", path, lineno);
+            exit(1);
+        }
+        n++;
+    }
+    fclose(file);
+    *count = n;
+    return renders;
+}
+
+// build the choir a render asks for
+static void make_choir(struct Render *render, struct Choir *choir, int quiet, int nthreads) {
+    int rate = render->inside_rate ? render->inside_rate : render->sample_rate;
+    if(quiet)
+        init_quiet_choir(choir, render->nvoices, rate, render->length);
+    else
+        init_choir(choir, render->nvoices, rate, render->length);
+    set_choir_control_period(choir, render->period);
+    if(resample_choir(choir, render->sample_rate)) {
+        fprintf(stderr, "cant resample between %ihz and %ihz\n", render->sample_rate, render->inside_rate);
+        exit(1);
+    }
+    if(render->seed >= 0)
+        seed_choir(choir, render->seed);
+    if(render->glottis)
+        use_glottis(choir);
+    if(start_choir_threads(choir, nthreads, 0)) {
+        fprintf(stderr, "couldnt start voice threads\n");
+        exit(1);
+    }
+}
+
+// open the source of a render
+// the rate of a wav file overrides -r, it goes in rate unless thats NULL
+// (the chunks of a render all open it at once and the rate was already worked out when it was planned)
+static FILE *open_source(const struct Render *render, struct Wav *wav, int *rate) {
+    if(!render->source_path)
+        return NULL;
+    FILE *source = strcmp(render->source_path, "-") ? fopen(render->source_path, "rb") : stdin;
+    if(source == NULL) {
+        fprintf(stderr, "could not open source %s\n", render->source_path);
+        exit(1);
+    }
+    if(render->source_is_wav) {
+        if(wav_open_read(wav, source)) {
+            fprintf(stderr, "could not read wav file %s\n", render->source_path);
+            exit(1);
+        }
+        if(rate)
+            *rate = wav->rate;
+    }
+    return source;
+}
+
+// read up to n frames of source, returns how many there were
+static size_t read_source(struct Render *render, FILE *source, struct Wav *wav, sample_t *in, size_t n) {
+    if(render->source_is_wav)
+        return wav_read(wav, in, n);
+    if(source)
+        return fread(in, sizeof(sample_t), n, source);
+    return 0;
+}
+
+// read n frames of source from frame on, silence past the end (or with no source at all)
+static void read_source_at(struct Render *render, FILE *source, struct Wav *wav, long frame, sample_t *in, size_t n) {
+    size_t got = 0;
+    if(source) {
+        int failed = render->source_is_wav ? wav_seek(wav, frame) : fseek(source, frame * sizeof(sample_t), SEEK_SET);
+        if(failed) {
+            fprintf(stderr, "could not seek in %s\n", render->source_path);
+            exit(1);
+        }
+        got = read_source(render, source, wav, in, n);
+    }
+    memset(in + got, 0, sizeof(sample_t) * (n - got));
+}
+
+// write n frames of output where the file is at
+static void write_output(struct Render *render, FILE *output, struct Wav *wav, const sample_t *out, size_t n) {
+    size_t written = render->output_is_wav ? wav_write(wav, out, n) : fwrite(out, sizeof(sample_t), n, output);
+    if(written != n) {
+        fprintf(stderr, "could not write to %s\n", render->output_path);
+        exit(1);
+    }
+}
+
+// and from a particular frame
+static void seek_output(struct Render *render, FILE *output, struct Wav *wav, long frame) {
+    int failed = render->output_is_wav ? wav_seek(wav, frame) : fseek(output, frame * sizeof(sample_t), SEEK_SET);
+    if(failed) {
+        fprintf(stderr, "could not seek in %s\n", render->output_path);
+        exit(1);
+    }
+}
+
+// reopen the output of a chunked render to fill some of it in
+static FILE *reopen_output(struct Render *render, struct Wav *wav) {
+    FILE *output = fopen(render->output_path, "r+b");
+    if(output == NULL) {
+        fprintf(stderr, "could not open output %s\n", render->output_path);
+        exit(1);
+    }
+    *wav = render->output_wav;
+    wav->file = output;
+    return output;
+}
+
+// the whole render in one go from start to finish, streaming (works with pipes)
+static void render_serial(struct Render *render, int quiet) {
+    // the tract talks on stdout, so if the audio is going there
+    // keep the real stdout for the audio and send the chatter to stderr
+    FILE *output;
+    if(!strcmp(render->output_path, "-")) {
+        output = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+        output = fopen(render->output_path, "wb");
+    }
+    if(output == NULL) {
+        fprintf(stderr, "could not open output %s\n", render->output_path);
+        exit(1);
+    }
+
+    // open the glottal source
+    struct Wav source_wav;
+    FILE *source = open_source(render, &source_wav, &render->sample_rate);
+    int sample_rate = render->sample_rate;
+
+    struct Wav output_wav;
+    if(render->output_is_wav && wav_open_write(&output_wav, output, sample_rate)) {
+        fprintf(stderr, "could not write wav file %s\n", render->output_path);
+        exit(1);
+    }
+
+    size_t nevents = 0;
+    struct Event *events = render->control_path ? load_events(render->control_path, sample_rate, &nevents) : NULL;
+    size_t next_event = 0;
+
+    // setup the vocal tract
+    struct Choir choir;
+    make_choir(render, &choir, quiet, render->nthreads);
+
+    // go dude go
+    sample_t in[RENDER_BLOCK];
+    sample_t out[RENDER_BLOCK];
+    long frame = 0;
+    long tail_frames = render->tail * sample_rate;
+    for(;;) {
+        size_t n = read_source(render, source, &source_wav, in, RENDER_BLOCK);
+
+        // once the source runs dry keep going with silence for the tail
+        if(n == 0) {
+            if(tail_frames <= 0)
+                break;
+            n = tail_frames < RENDER_BLOCK ? tail_frames : RENDER_BLOCK;
+            memset(in, 0, sizeof(sample_t) * n);
+            tail_frames -= n;
+        }
+
+        render_block(&choir, events, nevents, &next_event, frame, in, out, n);
+        frame += n;
+        write_output(render, output, &output_wav, out, n);
+    }
+
+    if(render->output_is_wav)
+        wav_close_write(&output_wav);
+    fclose(output);
+    if(source && source != stdin)
+        fclose(source);
+    free(events);
+    free_choir(&choir);
+
+    fprintf(stderr, "rendered %s, %li frames (%.2fs)\n", render->output_path, frame, (double)frame / sample_rate);
+}
+
+// somewhere near frame to start a new chunk where as little as possible is going on
+// no notes held if it can help it, then the quietest bit of source
+static long quiet_spot(struct Render *render, FILE *source, struct Wav *wav, long frame) {
+    long search = RENDER_SEARCH * render->sample_rate;
+    long first = frame - search, n = 2 * search + 2 * QUIET_STEP;
+    sample_t *in = malloc(sizeof(sample_t) * n);
+    read_source_at(render, source, wav, first - QUIET_STEP, in, n);
+
+    // which notes are down up to where the search starts
+    int notes = render->nvoices > 1 || render->glottis;
+    uint8_t held[16][128] = {{0}};
+    int nheld = 0;
+    size_t next = 0;
+
+    long best = frame;
+    double best_score = 1e300;
+    for(long spot = first; spot <= frame + search; spot += QUIET_STEP) {
+        for(; next < render->nevents && render->events[next].frame <= spot; next++) {
+            const struct Event *e = &render->events[next];
+            uint8_t type = e->buffer[0] & 0xf0, chan = e->buffer[0] & 0x0f;
+            if(!notes || e->size < 3 || chan == PHONEME_CHANNEL || (type != 0x80 && type != 0x90))
+                continue;
+            int on = type == 0x90 && e->buffer[2] > 0;
+            nheld += on - held[chan][e->buffer[1]];
+            held[chan][e->buffer[1]] = on;
+        }
+
+        // a held note counts for more than any amount of source
+        double energy = 0;
+        for(long i = spot - first; i < spot - first + 2 * QUIET_STEP; i++)
+            energy += in[i] * in[i];
+        double score = nheld * 1e30 + energy;
+        if(score < best_score) {
+            best_score = score;
+            best = spot;
+        }
+    }
+    free(in);
+    return best;
+}
+
+// work out how long a render comes out and where to cut it into chunks
+// leaves nchunks at 0 if it cant be cut up (it has to be able to seek about in the source and the output)
+static void plan_render(struct Render *render) {
+    if(!strcmp(render->output_path, "-") || (render->source_path && !strcmp(render->source_path, "-")))
+        return;
+
+    struct Wav source_wav;
+    FILE *source = open_source(render, &source_wav, &render->sample_rate);
+    long source_frames = 0;
+    if(render->source_is_wav) {
+        source_frames = source_wav.frames;
+        if(source_wav.data_offset < 0) {
+            fclose(source);
+            return;
+        }
+    } else if(source) {
+        if(fseek(source, 0, SEEK_END)) {
+            fclose(source);
+            return;
+        }
+        source_frames = ftell(source) / sizeof(sample_t);
+    }
+    int rate = render->sample_rate;
+    render->frames = source_frames + (long)(render->tail * rate);
+
+    // put the header in place, the chunks fill in the rest around it
+    FILE *output = fopen(render->output_path, "wb");
+    if(output == NULL) {
+        fprintf(stderr, "could not open output %s\n", render->output_path);
+        exit(1);
+    }
+    if(render->output_is_wav && wav_open_write(&render->output_wav, output, rate)) {
+        fprintf(stderr, "could not write wav file %s\n", render->output_path);
+        exit(1);
+    }
+    fclose(output);
+
+    if(render->control_path)
+        render->events = load_events(render->control_path, rate, &render->nevents);
+
+    // the last chunk takes whatever is left over so none of them are tiny
+    long chunk = RENDER_CHUNK * rate;
+    render->nchunks = render->frames / chunk;
+    if(render->nchunks < 1)
+        render->nchunks = 1;
+    render->bounds = malloc(sizeof(long) * (render->nchunks + 1));
+    render->bounds[0] = 0;
+    for(int k = 1; k < render->nchunks; k++)
+        render->bounds[k] = quiet_spot(render, source, &source_wav, k * chunk);
+    render->bounds[render->nchunks] = render->frames;
+    render->seams = calloc((render->nchunks - 1) * 2 * RENDER_FADE + 1, sizeof(sample_t));
+    if(source)
+        fclose(source);
+}
+
+// keep whatever of the n frames from frame falls between from and to, in dest (which starts at from)
+static void keep_frames(long frame, const sample_t *out, size_t n, long from, long to, sample_t *dest) {
+    long start = frame > from ? frame : from;
+    long stop = frame + (long)n < to ? frame + (long)n : to;
+    if(stop > start)
+        memcpy(dest + (start - from), out + (start - frame), sizeof(sample_t) * (stop - start));
+}
+
+// render one chunk of a planned render
+// it starts a little early so the tract is already going, and runs a little over the end
+// so the next chunk can crossfade into it (see stitch_render())
+static void render_chunk(struct Render *render, int k) {
+    int rate = render->sample_rate;
+    int last = k == render->nchunks - 1;
+    long begin = render->bounds[k], end = render->bounds[k + 1];
+    long start = begin - (long)(RENDER_WARMUP * rate);
+    if(start < 0 || k == 0)
+        start = 0;
+    long stop = last ? end : end + RENDER_FADE;
+    long body = k > 0 ? begin + RENDER_FADE : begin; // what it writes straight to the file
+    sample_t *head = k > 0 ? render->seams + (k - 1) * 2 * RENDER_FADE + RENDER_FADE : NULL;
+    sample_t *tail = !last ? render->seams + k * 2 * RENDER_FADE : NULL;
+
+    // every chunk has its own noise, the first one is the same as rendering it all in one go
+    struct Choir choir;
+    make_choir(render, &choir, 1, 0);
+    if(k > 0)
+        seed_choir(&choir, (render->seed >= 0 ? render->seed : DEFAULT_NOISE_SEED) + k * MAX_VOICES);
+
+    // everything before the warm up happens at once and the shape jumps to wherever it had got to
+    size_t next = 0;
+    for(; next < render->nevents && render->events[next].frame < start; next++)
+        apply_event(&choir, &render->events[next]);
+    if(k > 0)
+        snap_choir(&choir);
+
+    struct Wav source_wav, output_wav;
+    FILE *source = open_source(render, &source_wav, NULL);
+    FILE *output = reopen_output(render, &output_wav);
+    seek_output(render, output, &output_wav, body);
+
+    sample_t in[RENDER_BLOCK];
+    sample_t out[RENDER_BLOCK];
+    for(long frame = start; frame < stop;) {
+        size_t n = stop - frame < RENDER_BLOCK ? stop - frame : RENDER_BLOCK;
+        read_source_at(render, source, &source_wav, frame, in, n);
+        render_block(&choir, render->events, render->nevents, &next, frame, in, out, n);
+
+        if(k > 0)
+            keep_frames(frame, out, n, begin, body, head);
+        if(!last)
+            keep_frames(frame, out, n, end, stop, tail);
+        long from = frame > body ? frame : body;
+        long to = frame + (long)n < end ? frame + (long)n : end;
+        if(to > from)
+            write_output(render, output, &output_wav, out + (from - frame), to - from);
+        frame += n;
+    }
+
+    fclose(output);
+    if(source)
+        fclose(source);
+    free_choir(&choir);
+}
+
+// crossfade the chunks into each other where they meet and finish the header
+static void stitch_render(struct Render *render) {
+    struct Wav output_wav;
+    FILE *output = reopen_output(render, &output_wav);
+    sample_t seam[RENDER_FADE];
+    for(int k = 1; k < render->nchunks; k++) {
+        const sample_t *tail = render->seams + (k - 1) * 2 * RENDER_FADE;
+        const sample_t *head = tail + RENDER_FADE;
+        for(int i = 0; i < RENDER_FADE; i++) {
+            // theyre nearly the same signal so a straight line keeps the level
+            sample_t w = (i + 0.5) / RENDER_FADE;
+            seam[i] = tail[i] * (1 - w) + head[i] * w;
+        }
+        seek_output(render, output, &output_wav, render->bounds[k]);
+        write_output(render, output, &output_wav, seam, RENDER_FADE);
+    }
+    if(render->output_is_wav) {
+        output_wav.frames = render->frames;
+        wav_close_write(&output_wav);
+    }
+    fclose(output);
+    fprintf(stderr, "rendered %s, %li frames (%.2fs) in %i chunks\n", render->output_path, render->frames,
+            (double)render->frames / render->sample_rate, render->nchunks);
+}
+
+// a chunk of a render, or a whole one that cant be cut up
+struct Task {
+    struct Render *render;
+    int chunk; // -1 = all in one go
+};
+
+static void run_task(void *arg, int job, int worker) {
+    struct Task *task = (struct Task *)arg + job;
+    if(task->chunk < 0)
+        render_serial(task->render, 1);
+    else
+        render_chunk(task->render, task->chunk);
+}
+
+int main(int argc, char **argv) {
+    struct Render single;
+    default_render(&single);
+    const char *batch_path = NULL;
+    int parallel = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, RENDER_OPTIONS "m:V:P:b:h")) != -1) {
+        if(!render_option(&single, opt, optarg))
+            continue;
+        switch(opt) {
+            case 'm': if(load_phoneme_map(optarg)) exit(1); break;
+            case 'V': set_log_verbosity(atoi(optarg)); break;
+            case 'P': parallel = atoi(optarg); break;
+            case 'b': batch_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(parallel < 0 || parallel > MAX_POOL_THREADS + 1)
+        usage(argv[0]);
+
+    int nrenders = 1;
+    struct Render *renders = &single;
+    if(batch_path) {
+        if(optind != argc)
+            usage(argv[0]);
+        renders = load_batch(batch_path, &nrenders);
+    } else if(finish_options(&single, argc - optind, argv + optind)) {
+        usage(argv[0]);
+    }
+    for(int i = 0; i < nrenders; i++) {
+        renders[i].source_is_wav = renders[i].source_path && ends_with(renders[i].source_path, ".wav");
+        renders[i].output_is_wav = ends_with(renders[i].output_path, ".wav");
+    }
+
+    // one at a time, exactly like it always was
+    if(!parallel) {
+        for(int i = 0; i < nrenders; i++)
+            render_serial(&renders[i], 0);
+        return 0;
+    }
+
+    // cut everything up into chunks for the threads to share
+    int ntasks = 0;
+    for(int i = 0; i < nrenders; i++) {
+        plan_render(&renders[i]);
+        ntasks += renders[i].nchunks ? renders[i].nchunks : 1;
+    }
+    struct Task *tasks = malloc(sizeof(struct Task) * ntasks);
+    ntasks = 0;
+    for(int i = 0; i < nrenders; i++) {
+        for(int k = 0; k < renders[i].nchunks; k++)
+            tasks[ntasks++] = (struct Task){ &renders[i], k };
+        if(!renders[i].nchunks)
+            tasks[ntasks++] = (struct Task){ &renders[i], -1 };
+    }
+
+    // build one choir up front so the shared tables are ready before the threads get going
+    // (and it says what its doing once, the rest are all quiet)
+    struct Choir choir;
+    make_choir(&renders[0], &choir, 0, 0);
+    init_glottis();
+    free_choir(&choir);
+
+    struct Pool pool;
+    if(start_pool(&pool, parallel - 1, 0)) {
+        fprintf(stderr, "couldnt start render threads\n");
+        exit(1);
+    }
+    run_pool(&pool, run_task, tasks, ntasks);
+    stop_pool(&pool);
+
+    for(int i = 0; i < nrenders; i++) {
+        if(renders[i].nchunks)
+            stitch_render(&renders[i]);
+        free(renders[i].events);
+        free(renders[i].bounds);
+        free(renders[i].seams);
+    }
+    free(tasks);
+    if(renders != &single)
+        free(renders);
+    return 0;
+}
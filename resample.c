@@ -0,0 +1,126 @@
+/*
+ * polyphase resampler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+
+static int gcd(int a, int b) {
+    while(b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// modified bessel function of the first kind, for the kaiser window
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for(int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if(term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+int init_resampler(struct Resampler *resampler, int from_rate, int to_rate) {
+    memset(resampler, 0, sizeof(struct Resampler));
+    if(from_rate <= 0 || to_rate <= 0)
+        return -1;
+    int g = gcd(from_rate, to_rate);
+    resampler->up = to_rate / g;
+    resampler->down = from_rate / g;
+    if(resampler->up > MAX_RESAMPLE_PHASES)
+        return -1;
+
+    // cutoff in cycles per input sample, below whichever nyquist is lower
+    double cutoff = 0.5 * RESAMPLE_BANDWIDTH;
+    if(resampler->up < resampler->down)
+        cutoff *= (double)resampler->up / resampler->down;
+
+    // wide enough for RESAMPLE_ZEROS zero crossings either side
+    double half = RESAMPLE_ZEROS / (2 * cutoff);
+    int taps = 2 * (int)ceil(half);
+    resampler->taps = (taps + 7) / 8 * 8;
+
+    resampler->filter = malloc(sizeof(sample_t) * resampler->up * resampler->taps);
+    resampler->history = calloc(2 * resampler->taps, sizeof(sample_t));
+    if(resampler->filter == NULL || resampler->history == NULL) {
+        fprintf(stderr, "could not allocate resampler\n");
+        exit(1);
+    }
+
+    // output p of every input lands p/up of the way to the next one
+    // (half the filter late, so it only ever needs inputs it already has)
+    double window_norm = bessel_i0(RESAMPLE_BETA);
+    int center = resampler->taps / 2;
+    for(int p = 0; p < resampler->up; p++) {
+        sample_t *h = resampler->filter + p * resampler->taps;
+        double sum = 0;
+        for(int j = 0; j < resampler->taps; j++) {
+            // h[j] goes with the input j from the oldest, k back from the newest
+            int k = resampler->taps - 1 - j;
+            double d = k - center + (double)p / resampler->up;
+            double value = 0;
+            if(fabs(d) < half) {
+                double x = d / half;
+                double w = bessel_i0(RESAMPLE_BETA * sqrt(1 - x * x)) / window_norm;
+                double s = d == 0 ? 1 : sin(2 * M_PI * cutoff * d) / (2 * M_PI * cutoff * d);
+                value = 2 * cutoff * s * w;
+            }
+            h[j] = value;
+            sum += value;
+        }
+        // every phase lets dc through exactly the same
+        for(int j = 0; j < resampler->taps; j++)
+            h[j] /= sum;
+    }
+    return 0;
+}
+
+void free_resampler(struct Resampler *resampler) {
+    free(resampler->filter);
+    free(resampler->history);
+    resampler->filter = resampler->history = NULL;
+}
+
+void clear_resampler(struct Resampler *resampler) {
+    memset(resampler->history, 0, sizeof(sample_t) * 2 * resampler->taps);
+    resampler->pos = 0;
+    resampler->phase = 0;
+}
+
+int resampler_max_out(const struct Resampler *resampler, int n) {
+    return (int)(((long)n * resampler->up + resampler->up) / resampler->down) + 1;
+}
+
+int run_resampler(struct Resampler *resampler, const sample_t *in, int n, sample_t *out) {
+    int taps = resampler->taps;
+    int nout = 0;
+    for(int t = 0; t < n; t++) {
+        resampler->history[resampler->pos] = in[t];
+        resampler->history[resampler->pos + taps] = in[t];
+        if(++resampler->pos == taps)
+            resampler->pos = 0;
+        const sample_t *window = resampler->history + resampler->pos;
+
+        // every output between this input and the next
+        for(; resampler->phase < resampler->up; resampler->phase += resampler->down) {
+            const sample_t *h = resampler->filter + resampler->phase * taps;
+            // 8 sums side by side so the compiler can vectorize it without reordering anything
+            sample_t sum[8] = { 0 };
+            for(int j = 0; j < taps; j += 8)
+                for(int l = 0; l < 8; l++)
+                    sum[l] += h[j + l] * window[j + l];
+            out[nout++] = ((sum[0] + sum[1]) + (sum[2] + sum[3])) + ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+        }
+        resampler->phase -= resampler->up;
+    }
+    return nout;
+}
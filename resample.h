@@ -0,0 +1,50 @@
+/*
+ * polyphase resampler
+ *
+ * converts a stream of samples from one rate to another by a ratio of whole numbers
+ * (48000 -> 44100 is 147/160) with a windowed sinc, one phase of the filter per
+ * output position so every output is just a dot product with the last few inputs
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "tract.h"
+
+// zero crossings of the sinc on each side, more = sharper and more expensive
+#define RESAMPLE_ZEROS 16
+
+// how much of the band below the lower nyquist to keep
+#define RESAMPLE_BANDWIDTH 0.9
+
+// kaiser window beta (about 90db down outside the band)
+#define RESAMPLE_BETA 9
+
+// most phases the filter can have (the reduced output rate)
+// rates that dont share much end up with too many and are refused
+#define MAX_RESAMPLE_PHASES 1024
+
+struct Resampler {
+    int up, down; // out rate / in rate = up / down
+    int taps; // taps per phase (a multiple of 8 so the dot product vectorizes)
+    sample_t *filter; // phase p is taps long at [p * taps], oldest input first
+    sample_t *history; // the last taps inputs twice over so theyre always contiguous
+    int pos; // where the next input goes in history
+    int phase; // where the next output is between the last two inputs (in 1/up)
+};
+
+// returns 0 on success
+int init_resampler(struct Resampler *resampler, int from_rate, int to_rate);
+
+void free_resampler(struct Resampler *resampler);
+
+// forget everything its heard
+void clear_resampler(struct Resampler *resampler);
+
+// the most outputs n inputs can make
+int resampler_max_out(const struct Resampler *resampler, int n);
+
+// resample n input samples, returns how many came out
+int run_resampler(struct Resampler *resampler, const sample_t *in, int n, sample_t *out);
+
+#endif
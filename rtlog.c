@@ -0,0 +1,206 @@
+/*
+ * realtime safe logging
+ *
+ * a single producer single consumer ring: the audio thread only ever moves head
+ * and the log thread only ever moves tail, so it needs no locks
+ */
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "rtlog.h"
+
+struct LogArg {
+    char type; // the conversion its for
+    union {
+        long i;
+        double d;
+        const char *s;
+    };
+};
+
+struct LogRecord {
+    int nargs;
+    const char *format;
+    struct LogArg args[LOG_ARGS];
+};
+
+static struct LogRecord records[LOG_SIZE];
+static atomic_ulong head; // records written
+static atomic_ulong tail; // records printed
+static atomic_ulong dropped;
+static atomic_int verbosity = LOG_EVENTS;
+
+static FILE *log_out;
+static pthread_t log_thread;
+static atomic_int log_running;
+static atomic_int log_quit;
+
+// find the next conversion in a format string
+// returns a pointer to its % (or NULL) and sets *end to just past it
+static const char *next_conversion(const char *p, const char **end) {
+    for(; *p; p++) {
+        if(*p != '%')
+            continue;
+        if(p[1] == '%') {
+            p++;
+            continue;
+        }
+        const char *q = p + 1;
+        while(*q && !strchr("diuxXcfeEgGs", *q))
+            q++;
+        if(!*q)
+            return NULL;
+        *end = q + 1;
+        return p;
+    }
+    return NULL;
+}
+
+static void print_record(FILE *out, const struct LogRecord *record) {
+    const char *p = record->format;
+    const char *end;
+    const char *conversion;
+    int arg = 0;
+    while((conversion = next_conversion(p, &end)) != NULL && arg < record->nargs) {
+        // the plain text before it
+        for(; p < conversion; p++) {
+            fputc(*p, out);
+            if(p[0] == '%' && p[1] == '%')
+                p++;
+        }
+
+        // and the conversion on its own
+        char spec[32];
+        size_t n = end - conversion;
+        if(n >= sizeof(spec))
+            n = sizeof(spec) - 1;
+        memcpy(spec, conversion, n);
+        spec[n] = 0;
+        const struct LogArg *a = &record->args[arg++];
+        switch(a->type) {
+            case 'f': case 'e': case 'E': case 'g': case 'G':
+                fprintf(out, spec, a->d);
+                break;
+            case 's':
+                fprintf(out, spec, a->s);
+                break;
+            default:
+                fprintf(out, spec, (int)a->i);
+        }
+        p = end;
+    }
+    for(; *p; p++) {
+        fputc(*p, out);
+        if(p[0] == '%' && p[1] == '%')
+            p++;
+    }
+}
+
+void rt_log(int level, const char *format, ...) {
+    if(level > atomic_load_explicit(&verbosity, memory_order_relaxed))
+        return;
+
+    struct LogRecord direct;
+    struct LogRecord *record = &direct;
+    int threaded = atomic_load_explicit(&log_running, memory_order_acquire);
+    unsigned long h = atomic_load_explicit(&head, memory_order_relaxed);
+    if(threaded) {
+        if(h - atomic_load_explicit(&tail, memory_order_acquire) >= LOG_SIZE) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+        record = &records[h & (LOG_SIZE - 1)];
+    }
+
+    // pick up the arguments by walking the format
+    va_list args;
+    va_start(args, format);
+    record->format = format;
+    record->nargs = 0;
+    const char *p = format;
+    const char *end;
+    const char *conversion;
+    while(record->nargs < LOG_ARGS && (conversion = next_conversion(p, &end)) != NULL) {
+        struct LogArg *a = &record->args[record->nargs++];
+        a->type = end[-1];
+        switch(a->type) {
+            case 'f': case 'e': case 'E': case 'g': case 'G':
+                a->d = va_arg(args, double);
+                break;
+            case 's':
+                a->s = va_arg(args, const char *);
+                break;
+            default:
+                a->i = va_arg(args, int);
+        }
+        p = end;
+    }
+    va_end(args);
+
+    if(threaded)
+        atomic_store_explicit(&head, h + 1, memory_order_release);
+    else
+        print_record(stdout, record);
+}
+
+void set_log_verbosity(int level) {
+    atomic_store(&verbosity, level);
+}
+
+int log_verbosity() {
+    return atomic_load(&verbosity);
+}
+
+unsigned long log_dropped() {
+    return atomic_load(&dropped);
+}
+
+// print everything in the ring
+static void drain_log(unsigned long *reported) {
+    unsigned long h = atomic_load_explicit(&head, memory_order_acquire);
+    unsigned long t = atomic_load_explicit(&tail, memory_order_relaxed);
+    for(; t != h; t++) {
+        print_record(log_out, &records[t & (LOG_SIZE - 1)]);
+        atomic_store_explicit(&tail, t + 1, memory_order_release);
+    }
+
+    unsigned long d = log_dropped();
+    if(d != *reported) {
+        fprintf(log_out, "(log dropped %lu messages, %lu so far)\n", d - *reported, d);
+        *reported = d;
+    }
+    fflush(log_out);
+}
+
+static void *log_main(void *arg) {
+    unsigned long reported = 0;
+    struct timespec interval = { 0, LOG_INTERVAL * 1000000L };
+    while(!atomic_load_explicit(&log_quit, memory_order_acquire)) {
+        drain_log(&reported);
+        nanosleep(&interval, NULL);
+    }
+    drain_log(&reported);
+    return NULL;
+}
+
+int start_log_thread(FILE *out) {
+    if(atomic_load(&log_running))
+        return 0;
+    log_out = out;
+    atomic_store(&log_quit, 0);
+    if(pthread_create(&log_thread, NULL, log_main, NULL))
+        return -1;
+    atomic_store_explicit(&log_running, 1, memory_order_release);
+    return 0;
+}
+
+void stop_log_thread() {
+    if(!atomic_load(&log_running))
+        return;
+    atomic_store_explicit(&log_quit, 1, memory_order_release);
+    pthread_join(log_thread, NULL);
+    atomic_store(&log_running, 0);
+}
@@ -0,0 +1,48 @@
+/*
+ * realtime safe logging
+ *
+ * the audio thread cant printf (the terminal or a pipe can make it wait)
+ * so it drops fixed size records into a lock-free ring buffer instead
+ * and a normal thread formats and prints them a little later
+ */
+
+#ifndef RTLOG_H
+#define RTLOG_H
+
+#include <stdio.h>
+
+// how many records fit in the ring (a power of 2)
+#define LOG_SIZE 256
+
+// most arguments a record can carry
+#define LOG_ARGS 4
+
+// how often the log thread looks for new records (milliseconds)
+#define LOG_INTERVAL 10
+
+// verbosity levels, a message gets logged if its level <= the verbosity
+#define LOG_QUIET 0 // nothing at all
+#define LOG_INFO 1 // things worth knowing about
+#define LOG_EVENTS 2 // every midi event (the default)
+
+// log something from the audio thread (only the audio thread, theres one writer)
+// format is a printf format that must stay around (a string literal)
+// conversions can be d i u x X c (ints), f e g (doubles) or s (strings that stay around too)
+// with no width modifiers like l or h
+// never blocks: if the ring is full the message is dropped and counted
+void rt_log(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void set_log_verbosity(int level);
+int log_verbosity();
+
+// messages that didnt fit in the ring
+unsigned long log_dropped();
+
+// start the thread that prints the log to out
+// until then (like in the offline renderer) rt_log() prints straight away
+int start_log_thread(FILE *out);
+
+// print whatever is left and stop the thread
+void stop_log_thread();
+
+#endif
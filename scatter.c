@@ -0,0 +1,162 @@
+/*
+ * junction scattering kernels
+ *
+ * every kernel does exactly the same arithmetic in the same order as the
+ * scalar one (no fused multiply adds) so they all sound exactly the same,
+ * they just do more junctions at once
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "scatter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCATTER_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define SCATTER_NEON
+#include <arm_neon.h>
+#endif
+
+const struct ScatterKernel *scatter_kernel;
+
+// scatter junctions from..n-1 one at a time
+// the scalar kernel and the leftovers at the end of the simd kernels
+static inline void scatter_range(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                                 sample_t *restrict new_left, sample_t *restrict new_right,
+                                 const sample_t *restrict k, sample_t atten, int from, int n) {
+    for(int j = from; j < n; j++) {
+        sample_t r = old_right[j-1];
+        sample_t l = old_left[j];
+        new_right[j] = r - k[j] * (r + l * atten);
+        new_left[j-1] = l + k[j] * (l + r * atten);
+    }
+}
+
+static void scatter_scalar(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                           sample_t *restrict new_left, sample_t *restrict new_right,
+                           const sample_t *restrict k, sample_t atten, int n) {
+    scatter_range(old_left, old_right, new_left, new_right, k, atten, 1, n);
+}
+
+static int always_supported() {
+    return 1;
+}
+
+#ifdef SCATTER_X86
+
+__attribute__((target("sse2")))
+static void scatter_sse2(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                         sample_t *restrict new_left, sample_t *restrict new_right,
+                         const sample_t *restrict k, sample_t atten, int n) {
+    __m128 a = _mm_set1_ps(atten);
+    int j = 1;
+    for(; j + 4 <= n; j += 4) {
+        __m128 r = _mm_loadu_ps(old_right + j - 1);
+        __m128 l = _mm_loadu_ps(old_left + j);
+        __m128 g = _mm_loadu_ps(k + j);
+        _mm_storeu_ps(new_right + j, _mm_sub_ps(r, _mm_mul_ps(g, _mm_add_ps(r, _mm_mul_ps(l, a)))));
+        _mm_storeu_ps(new_left + j - 1, _mm_add_ps(l, _mm_mul_ps(g, _mm_add_ps(l, _mm_mul_ps(r, a)))));
+    }
+    scatter_range(old_left, old_right, new_left, new_right, k, atten, j, n);
+}
+
+static int sse2_supported() {
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("avx2")))
+static void scatter_avx2(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                         sample_t *restrict new_left, sample_t *restrict new_right,
+                         const sample_t *restrict k, sample_t atten, int n) {
+    __m256 a = _mm256_set1_ps(atten);
+    int j = 1;
+    for(; j + 8 <= n; j += 8) {
+        __m256 r = _mm256_loadu_ps(old_right + j - 1);
+        __m256 l = _mm256_loadu_ps(old_left + j);
+        __m256 g = _mm256_loadu_ps(k + j);
+        _mm256_storeu_ps(new_right + j, _mm256_sub_ps(r, _mm256_mul_ps(g, _mm256_add_ps(r, _mm256_mul_ps(l, a)))));
+        _mm256_storeu_ps(new_left + j - 1, _mm256_add_ps(l, _mm256_mul_ps(g, _mm256_add_ps(l, _mm256_mul_ps(r, a)))));
+    }
+    scatter_range(old_left, old_right, new_left, new_right, k, atten, j, n);
+}
+
+static int avx2_supported() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+#ifdef SCATTER_NEON
+
+static void scatter_neon(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                         sample_t *restrict new_left, sample_t *restrict new_right,
+                         const sample_t *restrict k, sample_t atten, int n) {
+    float32x4_t a = vdupq_n_f32(atten);
+    int j = 1;
+    for(; j + 4 <= n; j += 4) {
+        float32x4_t r = vld1q_f32(old_right + j - 1);
+        float32x4_t l = vld1q_f32(old_left + j);
+        float32x4_t g = vld1q_f32(k + j);
+        vst1q_f32(new_right + j, vsubq_f32(r, vmulq_f32(g, vaddq_f32(r, vmulq_f32(l, a)))));
+        vst1q_f32(new_left + j - 1, vaddq_f32(l, vmulq_f32(g, vaddq_f32(l, vmulq_f32(r, a)))));
+    }
+    scatter_range(old_left, old_right, new_left, new_right, k, atten, j, n);
+}
+
+#endif
+
+void scatter_frication(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                       sample_t *restrict new_left, sample_t *restrict new_right,
+                       const sample_t *restrict k, sample_t atten,
+                       const sample_t *restrict noise_left, const sample_t *restrict noise_right,
+                       sample_t fric, int n) {
+    for(int j = 1; j < n; j++) {
+        sample_t r = old_right[j-1];
+        sample_t l = old_left[j];
+        sample_t back = r * k[j]; // right moving wave bouncing back left
+        sample_t forth = -l * k[j]; // left moving wave bouncing back right
+
+        // frication
+        // due to wind hitting obstruction (increase in impedence)
+        sample_t wind_left = back > 0 ? back : 0;
+        sample_t wind_right = forth > 0 ? forth : 0;
+
+        new_right[j] = r - back + forth * atten + fric * wind_right * noise_right[j];
+        new_left[j-1] = l - forth + back * atten + fric * wind_left * noise_left[j];
+    }
+}
+
+const struct ScatterKernel scatter_kernels[] = {
+#ifdef SCATTER_X86
+    { "avx2", avx2_supported, scatter_avx2 },
+    { "sse2", sse2_supported, scatter_sse2 },
+#endif
+#ifdef SCATTER_NEON
+    // if the compiler was allowed to use neon the cpu has it
+    { "neon", always_supported, scatter_neon },
+#endif
+    { "scalar", always_supported, scatter_scalar },
+};
+const int nscatter_kernels = sizeof(scatter_kernels) / sizeof(*scatter_kernels);
+
+int select_scatter_kernel(const char *name) {
+#ifdef SCATTER_X86
+    __builtin_cpu_init();
+#endif
+    for(int i = 0; i < nscatter_kernels; i++) {
+        const struct ScatterKernel *kernel = &scatter_kernels[i];
+        if(name != NULL && strcmp(name, kernel->name))
+            continue;
+        if(!kernel->supported()) {
+            if(name != NULL)
+                return -1;
+            continue;
+        }
+        scatter_kernel = kernel;
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,44 @@
+/*
+ * junction scattering kernels
+ *
+ * the interior junctions of the tract (everything but the glottis and the lips)
+ * hand vectorized for whatever the cpu has, picked when the tract starts up
+ */
+
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include "tract.h"
+
+// a way of scattering the waves at every junction between two segments
+// k[j] is the reflection coefficient for waves going from segment j-1 into segment j
+// writes new_right[1..n-1] and new_left[0..n-2]
+struct ScatterKernel {
+    const char *name;
+    int (*supported)(); // 1 if this cpu can run it
+    void (*scatter)(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                    sample_t *restrict new_left, sample_t *restrict new_right,
+                    const sample_t *restrict k, sample_t atten, int n);
+};
+
+// every kernel this build knows about, fastest first, scalar last
+extern const struct ScatterKernel scatter_kernels[];
+extern const int nscatter_kernels;
+
+// the kernel the tract is using
+extern const struct ScatterKernel *scatter_kernel;
+
+// scatter with wind noise where the waves hit an obstruction
+// noise_left[j] and noise_right[j] are the noise for the waves leaving junction j
+// plain c but written so the compiler can vectorize it
+void scatter_frication(const sample_t *restrict old_left, const sample_t *restrict old_right,
+                       sample_t *restrict new_left, sample_t *restrict new_right,
+                       const sample_t *restrict k, sample_t atten,
+                       const sample_t *restrict noise_left, const sample_t *restrict noise_right,
+                       sample_t fric, int n);
+
+// pick a kernel by name, or the fastest one this cpu supports if name is NULL
+// returns 0 on success
+int select_scatter_kernel(const char *name);
+
+#endif
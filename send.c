@@ -0,0 +1,123 @@
+/*
+ * nancealoid-send
+ *
+ * drives a running nancealoid (started with -Q) from another process
+ * reads lines of a time in seconds and a control event, like the offline renderers
+ * control stream, and sends each one a little before its due
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#include "control.h"
+
+// how far ahead of the tract events get sent (seconds)
+// has to be more than a jack period or they land late
+#define SEND_LEAD 0.05
+
+// how long to wait for the ring to have room again (milliseconds)
+#define SEND_RETRY 1
+
+void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-l secs] <name> [file]\n"
+        "\n"
+        "  <name>   the -Q name nancealoid was started with\n"
+        "  [file]   the control events (default stdin)\n"
+        "  -l secs  how far ahead of the tract to schedule everything (default %.2f)\n"
+        "\n"
+        "each line is a time in seconds from the start followed by a control and its value\n"
+        "(phoneme height position roundedness, length cm, pressure, damping, drag, velum)\n"
+        "for example:\n"
+        "\n"
+        "  0.0  pressure 0.2\n"
+        "  0.0  phoneme 0.9 0.1 0\n"
+        "  0.5  length 15.5\n"
+        "\n", name, SEND_LEAD);
+    exit(1);
+}
+
+static void sleep_ms(int ms) {
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&t, NULL);
+}
+
+int main(int argc, char **argv) {
+    double lead = SEND_LEAD;
+
+    int opt;
+    while((opt = getopt(argc, argv, "l:h")) != -1) {
+        switch(opt) {
+            case 'l': lead = atof(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    int npaths = argc - optind;
+    if(npaths < 1 || npaths > 2 || lead < 0)
+        usage(argv[0]);
+    const char *name = argv[optind];
+    const char *path = npaths == 2 ? argv[optind + 1] : "-";
+
+    struct ControlQueue *queue = share_control_queue(name, 0, 0);
+    if(queue == NULL) {
+        fprintf(stderr, "couldnt open control queue %s (is nancealoid running with -Q %s?)\n", name, name);
+        exit(1);
+    }
+    FILE *file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if(file == NULL) {
+        fprintf(stderr, "could not open %s\n", path);
+        exit(1);
+    }
+
+    int rate = queue->rate;
+    uint64_t lead_frames = lead * rate;
+    uint64_t start = 0;
+
+    char line[256];
+    int lineno = 0;
+    unsigned long sent = 0;
+    while(fgets(line, sizeof(line), file)) {
+        lineno++;
+
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = 0;
+        char *p = line;
+        while(isspace((unsigned char)*p))
+            p++;
+        if(*p == 0)
+            continue;
+
+        char *end;
+        double time = strtod(p, &end);
+        struct ControlEvent event;
+        if(end == p || !isfinite(time) || time < 0 || parse_control(end, &event)) {
+            fprintf(stderr, "%s:%i: bad control event\n", path, lineno);
+            exit(1);
+        }
+
+        // everything counts from wherever the tract is when the first event turns up
+        if(sent == 0)
+            start = control_frame(queue) + lead_frames;
+        event.time = start + (uint64_t)(time * rate + 0.5);
+
+        // dont get much further ahead than the lead (so a long file doesnt fill the ring)
+        // nor give up if the ring is full, just wait for the tract to catch up
+        while(event.time > control_frame(queue) + lead_frames + rate / 10)
+            sleep_ms(SEND_RETRY);
+        while(send_control(queue, &event))
+            sleep_ms(SEND_RETRY);
+        sent++;
+    }
+
+    if(file != stdin)
+        fclose(file);
+    fprintf(stderr, "sent %lu events (the ring was full %lu times)\n", sent, (unsigned long)atomic_load(&queue->dropped));
+    unshare_control_queue(queue, name, 0);
+    return 0;
+}
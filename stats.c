@@ -0,0 +1,158 @@
+/*
+ * dsp load stats
+ *
+ * the window ring works just like the logs: the audio thread only ever moves head
+ * and the stats thread only ever moves tail
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+static void clear_window(struct StatsWindow *window) {
+    memset(window, 0, sizeof(struct StatsWindow));
+    window->min = 1e30;
+}
+
+void init_stats(struct Stats *stats, double interval) {
+    memset(stats, 0, sizeof(struct Stats));
+    stats->interval = interval > 0 ? interval : STATS_INTERVAL;
+    clear_window(&stats->window);
+}
+
+void stats_cycle(struct Stats *stats, uint64_t busy_ns, uint64_t period_ns, const uint64_t *stage_ns) {
+    if(period_ns == 0)
+        return;
+    struct StatsWindow *window = &stats->window;
+    double load = (double)busy_ns / period_ns;
+    window->cycles++;
+    window->seconds += period_ns * 1e-9;
+    window->sum += load;
+    if(load < window->min)
+        window->min = load;
+    if(load > window->max)
+        window->max = load;
+    for(int i = 0; i < NSTAGES; i++)
+        window->stages[i] += (double)stage_ns[i] / period_ns;
+    int bucket = (int)(load / STATS_BUCKET_WIDTH);
+    window->histogram[bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1]++;
+
+    if(window->seconds < stats->interval)
+        return;
+
+    // hand it over (or drop it if the stats thread is way behind)
+    unsigned long h = atomic_load_explicit(&stats->head, memory_order_relaxed);
+    if(h - atomic_load_explicit(&stats->tail, memory_order_acquire) < STATS_QUEUE) {
+        stats->queue[h & (STATS_QUEUE - 1)] = *window;
+        atomic_store_explicit(&stats->head, h + 1, memory_order_release);
+    } else {
+        atomic_fetch_add_explicit(&stats->dropped, 1, memory_order_relaxed);
+    }
+    clear_window(window);
+}
+
+void stats_xrun(struct Stats *stats) {
+    atomic_fetch_add_explicit(&stats->xruns, 1, memory_order_relaxed);
+}
+
+// the load 99% of the cycles came in under
+static double percentile_99(const struct StatsWindow *window) {
+    unsigned long want = window->cycles - window->cycles / 100;
+    unsigned long count = 0;
+    for(int i = 0; i < STATS_BUCKETS; i++) {
+        count += window->histogram[i];
+        if(count >= want) {
+            // the top of the bucket, but never more than the slowest cycle really was
+            double load = (i + 1) * STATS_BUCKET_WIDTH;
+            return load < window->max ? load : window->max;
+        }
+    }
+    return window->max;
+}
+
+// all the numbers as key value lines, written next to the file and moved over it
+// so whoever reads it never sees half of one
+static void write_stats_file(const char *path, const struct StatsWindow *window, double p99,
+                             unsigned long xruns, unsigned long new_xruns, unsigned long dropped) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if(f == NULL)
+        return;
+    fprintf(f, "seconds %g\n", window->seconds);
+    fprintf(f, "cycles %lu\n", window->cycles);
+    fprintf(f, "load_min %g\n", window->min);
+    fprintf(f, "load_mean %g\n", window->sum / window->cycles);
+    fprintf(f, "load_p99 %g\n", p99);
+    fprintf(f, "load_max %g\n", window->max);
+    fprintf(f, "load_midi %g\n", window->stages[STAGE_MIDI] / window->cycles);
+    fprintf(f, "load_shape %g\n", window->stages[STAGE_SHAPE] / window->cycles);
+    fprintf(f, "load_scatter %g\n", window->stages[STAGE_SCATTER] / window->cycles);
+    fprintf(f, "xruns %lu\n", new_xruns);
+    fprintf(f, "xruns_total %lu\n", xruns);
+    fprintf(f, "windows_dropped %lu\n", dropped);
+    fclose(f);
+    rename(tmp, path);
+}
+
+static void report_window(struct Stats *stats, const struct StatsWindow *window, unsigned long *reported_xruns) {
+    if(window->cycles == 0)
+        return;
+    double p99 = percentile_99(window);
+    unsigned long xruns = atomic_load(&stats->xruns);
+    unsigned long new_xruns = xruns - *reported_xruns;
+    *reported_xruns = xruns;
+    unsigned long dropped = atomic_load(&stats->dropped);
+
+    fprintf(stats->out,
+        "load min %.1f%% mean %.1f%% p99 %.1f%% max %.1f%% (midi %.2f%% shape %.2f%% scatter %.1f%%) xruns %lu (%lu total) over %.1fs\n",
+        window->min * 100, window->sum / window->cycles * 100, p99 * 100, window->max * 100,
+        window->stages[STAGE_MIDI] / window->cycles * 100,
+        window->stages[STAGE_SHAPE] / window->cycles * 100,
+        window->stages[STAGE_SCATTER] / window->cycles * 100,
+        new_xruns, xruns, window->seconds);
+    fflush(stats->out);
+    if(stats->path)
+        write_stats_file(stats->path, window, p99, xruns, new_xruns, dropped);
+}
+
+static void drain_stats(struct Stats *stats, unsigned long *reported_xruns) {
+    unsigned long h = atomic_load_explicit(&stats->head, memory_order_acquire);
+    unsigned long t = atomic_load_explicit(&stats->tail, memory_order_relaxed);
+    for(; t != h; t++) {
+        report_window(stats, &stats->queue[t & (STATS_QUEUE - 1)], reported_xruns);
+        atomic_store_explicit(&stats->tail, t + 1, memory_order_release);
+    }
+}
+
+static void *stats_main(void *arg) {
+    struct Stats *stats = arg;
+    unsigned long reported_xruns = 0;
+    struct timespec interval = { 0, STATS_POLL * 1000000L };
+    while(!atomic_load_explicit(&stats->quit, memory_order_acquire)) {
+        drain_stats(stats, &reported_xruns);
+        nanosleep(&interval, NULL);
+    }
+    drain_stats(stats, &reported_xruns);
+    return NULL;
+}
+
+int start_stats_thread(struct Stats *stats, FILE *out, const char *path) {
+    if(stats->running)
+        return 0;
+    stats->out = out;
+    stats->path = path;
+    atomic_store(&stats->quit, 0);
+    if(pthread_create(&stats->thread, NULL, stats_main, stats))
+        return -1;
+    stats->running = 1;
+    return 0;
+}
+
+void stop_stats_thread(struct Stats *stats) {
+    if(!stats->running)
+        return;
+    atomic_store_explicit(&stats->quit, 1, memory_order_release);
+    pthread_join(stats->thread, NULL);
+    stats->running = 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * dsp load stats
+ *
+ * the audio thread times every cycle and adds it to a window of stats,
+ * every now and then it hands the finished window over through a lock-free ring
+ * and a normal thread prints it (and keeps a file up to date for anything that wants to scrape it)
+ * so we can tell how close to the deadline the callback runs and how many voices a machine can take
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+// the load histogram (for the 99th percentile) goes in 1/4% steps up to 200%
+// anything slower than that lands in the last bucket
+#define STATS_BUCKETS 800
+#define STATS_BUCKET_WIDTH 0.0025
+
+// finished windows waiting for the stats thread (a power of 2)
+#define STATS_QUEUE 8
+
+// seconds of audio in a window if nobody says otherwise
+#define STATS_INTERVAL 5
+
+// how often the stats thread looks for finished windows (milliseconds)
+#define STATS_POLL 100
+
+// what the callback spends its time on
+#define STAGE_MIDI 0 // getting the midi events and applying them (and anything else outside the tracts)
+#define STAGE_SHAPE 1 // moving the tract walls and working out the coefficients
+#define STAGE_SCATTER 2 // everything else running the tracts (mostly the waves scattering)
+#define NSTAGES 3
+
+// everything about some number of cycles
+// loads are the time a cycle took over the time its period lasts
+struct StatsWindow {
+    unsigned long cycles;
+    double seconds; // of audio
+    double min, max, sum; // load of a whole cycle
+    double stages[NSTAGES]; // summed load of each stage
+    unsigned histogram[STATS_BUCKETS];
+};
+
+struct Stats {
+    double interval; // seconds of audio per window
+
+    // only the audio thread touches this
+    struct StatsWindow window;
+
+    // single producer single consumer, like the log
+    struct StatsWindow queue[STATS_QUEUE];
+    atomic_ulong head; // windows finished
+    atomic_ulong tail; // windows reported
+    atomic_ulong dropped; // windows that didnt fit
+
+    atomic_ulong xruns; // since the start
+
+    // the stats thread
+    FILE *out;
+    const char *path;
+    pthread_t thread;
+    int running;
+    atomic_int quit;
+};
+
+// now in nanoseconds (fine to call from the audio thread)
+static inline uint64_t clock_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// every window covers interval seconds of audio
+void init_stats(struct Stats *stats, double interval);
+
+// add a cycle that took busy_ns out of the period_ns it had (audio thread only)
+// stage_ns is how long each of the NSTAGES stages took
+void stats_cycle(struct Stats *stats, uint64_t busy_ns, uint64_t period_ns, const uint64_t *stage_ns);
+
+// count an xrun (from any thread)
+void stats_xrun(struct Stats *stats);
+
+// start the thread that prints every window to out
+// and rewrites the file at path (if its not NULL) with the latest one
+// returns 0 on success
+int start_stats_thread(struct Stats *stats, FILE *out, const char *path);
+
+// report whatever is left and stop the thread
+void stop_stats_thread(struct Stats *stats);
+
+#endif
@@ -0,0 +1,1204 @@
+/*
+ * nancealoid tract engine
+ *
+ * simulates a vocal tract using a 1d digital waveguide
+ * the glottal source is filtered by the tract and comes out the lips
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+#include "tract.h"
+#include "scatter.h"
+#include "fixed.h"
+#include "noise.h"
+#include "rtlog.h"
+#include "stats.h"
+
+// return a pointer to a phoneme that is mapped to a midi note value
+struct Phoneme *get_mapped_phoneme(struct Tract *tract, uint8_t note) {
+    int i = phoneme_map.notes[note & 0x7f];
+    return i < 0 ? &tract->ambient_phoneme : &phoneme_map.phonemes[i];
+}
+
+// swap buffers by swapping pointers
+void swap_buffers(struct Tract *tract) {
+    if(tract->segments_front == tract->buffer1) {
+        tract->segments_front = tract->buffer2;
+        tract->segments_back = tract->buffer1;
+    } else {
+        tract->segments_front = tract->buffer1;
+        tract->segments_back = tract->buffer2;
+    }
+    sample_t *tmp = tract->left_front;
+    tract->left_front = tract->left_back;
+    tract->left_back = tmp;
+    tmp = tract->right_front;
+    tract->right_front = tract->right_back;
+    tract->right_back = tmp;
+}
+
+// how many samples to allocate for an array of n samples
+// rounded up to a whole number of cache lines so simd loops can run off the end
+int padded_length(int n) {
+    int per_line = TRACT_ALIGN / sizeof(sample_t);
+    return (n + per_line) / per_line * per_line;
+}
+
+// allocate a zeroed, cache line aligned, padded array of samples
+sample_t *alloc_samples(int n) {
+    void *p;
+    size_t size = sizeof(sample_t) * n;
+    if(posix_memalign(&p, TRACT_ALIGN, size)) {
+        fprintf(stderr, "could not allocate tract memory\n");
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+void advance_tract(struct Tract *tract, int n);
+double reflection(double source_z, double target_z);
+
+// update the shape of the tract
+// to wherever the crossfade between the two profiles has got to
+void update_shape(struct Tract *tract, int set_z) {
+    const double *from = tract->profile_from;
+    const double *to = tract->profile_to;
+    double fade = tract->fade;
+
+    // iterate over all the segments
+    for(int i = 0; i < tract->nsegments; i++) {
+        struct Segment *s = &(tract->segments_front[i]);
+        double area = from[i] * (1 - fade) + to[i] * fade;
+        s->target_z = NEUTRAL_Z / area;
+        if(set_z)
+            s->z = s->target_z;
+    }
+
+    // only bother recalculating coefficients if something actually moved
+    for(int i = 0; i < tract->nsegments && !tract->shape_dirty; i++) {
+        struct Segment *s = &(tract->segments_front[i]);
+        if(s->z != s->target_z)
+            tract->shape_dirty = 1;
+    }
+}
+
+// the area profile of the shape the tract is in right now
+void blend_profile(struct Tract *tract, double *area) {
+    for(int i = 0; i < tract->nsegments; i++)
+        area[i] = tract->profile_from[i] * (1 - tract->fade) + tract->profile_to[i] * tract->fade;
+}
+
+// point profile_to at the shape of the target phoneme
+// one of the precomputed ones if its in the map (which it is for every note)
+void target_profile(struct Tract *tract) {
+    tract->to_phoneme = *tract->target_phoneme;
+    for(int p = 0; p < tract->nprofiles; p++) {
+        if(same_phoneme(&phoneme_map.phonemes[p], &tract->to_phoneme)) {
+            tract->profile_to = tract->profiles + p * tract->capacity;
+            return;
+        }
+    }
+    phoneme_profile(&tract->to_phoneme, tract->profile_free, tract->nsegments);
+    tract->profile_to = tract->profile_free;
+}
+
+// start crossfading from wherever the shape is now to the target phoneme
+void retarget_shape(struct Tract *tract) {
+    blend_profile(tract, tract->profile_from);
+    target_profile(tract);
+    tract->fade = 0;
+}
+
+// coefficient of a first order (thiran) allpass that delays by some samples
+double allpass_coefficient(double delay) {
+    return (1 - delay) / (1 + delay);
+}
+
+// stretch an area profile of n segments out (or in) to m segments
+void stretch_profile(const double *area, int n, double *out, int m) {
+    for(int i = 0; i < m; i++) {
+        double x = (i + 0.5) * n / m - 0.5;
+        if(x < 0) x = 0;
+        if(x > n - 1) x = n - 1;
+        int j = (int)x;
+        int k = j + 1 < n ? j + 1 : j;
+        out[i] = area[j] + (area[k] - area[j]) * (x - j);
+    }
+}
+
+// where the nose branches off the tract
+int velum_segment(struct Tract *tract) {
+    int v = (int)(VELUM_POSITION * tract->nsegments + 0.5);
+    if(v < 1) v = 1;
+    if(v > tract->nsegments - 1) v = tract->nsegments - 1;
+    return v;
+}
+
+// the shape of the nose, the way in is as wide as the velum lets it be
+// then it opens up into the nasal cavity and narrows again at the nostrils
+void shape_nose(struct Tract *tract) {
+    for(int i = 0; i < tract->nose_length; i++) {
+        double area;
+        if(i == 0) {
+            area = tract->velum * NOSE_PORT_AREA + MIN_AREA;
+        } else {
+            double x = (double)i / (tract->nose_length - 1);
+            area = 0.4 + 0.6 * sin(M_PI * x);
+        }
+        struct Segment *f = &tract->segments_front[tract->nose_start + i];
+        struct Segment *b = &tract->segments_back[tract->nose_start + i];
+        f->z = f->target_z = NEUTRAL_Z / area;
+        f->rigidity = 1;
+        *b = *f;
+    }
+}
+
+// describe the tract as a network of tubes and compile it into the schedule
+// with the velum shut its one tube from the glottis to the lips
+// otherwise the throat and the mouth meet the nose at a 3 port junction
+void build_network(struct Tract *tract) {
+    struct Network network;
+    memset(&network, 0, sizeof(network));
+    int n = tract->nsegments;
+    tract->fixed = NULL;
+    int nose_coefficients = tract->nose_start + tract->nose_length;
+    tract->nose_open = tract->velum > 0 && n >= 2;
+    if(tract->nose_open) {
+        int v = velum_segment(tract);
+        network.ntubes = 3;
+        network.tubes[0] = (struct Tube){ 0, v, 1, { END_GLOTTIS, END_JOINED }, 0 }; // throat
+        network.tubes[1] = (struct Tube){ v, n - v, 1, { END_JOINED, END_LIPS }, 0 }; // mouth
+        network.tubes[2] = (struct Tube){ tract->nose_start, tract->nose_length, 0, { END_JOINED, END_OPEN }, nose_coefficients + 3 };
+        network.njoins = 1;
+        network.joins[0] = (struct Join){ 3, { { 0, END_RIGHT }, { 1, END_LEFT }, { 2, END_LEFT } }, nose_coefficients };
+        if(compile_network(&network, &tract->schedule) == 0) {
+            tract->ncoefficients = nose_coefficients + NOSE_COEFFICIENTS;
+            return;
+        }
+        // cant happen, but a tract without a nose is better than no tract
+        tract->nose_open = 0;
+        memset(&network, 0, sizeof(network));
+    }
+    network.ntubes = 1;
+    network.tubes[0] = (struct Tube){ 0, n, 1, { END_GLOTTIS, END_LIPS }, 0 };
+    compile_network(&network, &tract->schedule);
+    tract->ncoefficients = n;
+    // maybe theres a kernel for exactly this long
+    tract->fixed = find_fixed_kernel(n);
+}
+
+// the coefficients for the nose (as long as its open)
+// the junctions inside it, the weights of every tube at the velum and the reflection at the nostrils
+void nose_targets(struct Tract *tract) {
+    const struct Segment *s = tract->segments_front;
+    int start = tract->nose_start;
+    int c = start + tract->nose_length;
+    for(int j = start + 1; j < c; j++)
+        tract->junction_target[j] = reflection(s[j-1].z, s[j].z);
+
+    // the waves leaving the velum share out everything arriving there
+    // each tube getting more the wider it is
+    const struct Split *split = &tract->schedule.splits[0];
+    double total = 0;
+    for(int p = 0; p < split->nports; p++)
+        total += 1 / s[split->segment[p]].z;
+    for(int p = 0; p < split->nports; p++)
+        tract->junction_target[split->coefficient + p] = 2 / s[split->segment[p]].z / total;
+
+    tract->junction_target[c + 3] = reflection(s[c - 1].z, DRAIN_Z);
+}
+
+void set_velum(struct Tract *tract, double velum) {
+    if(velum < 0) velum = 0;
+    if(velum > 1) velum = 1;
+    if(velum == tract->velum)
+        return;
+    int was_open = tract->nose_open;
+    tract->velum = velum;
+    shape_nose(tract);
+    build_network(tract);
+
+    // carry on from the coefficients the tract has right now rather than jumping
+    // (a closed velum is the same junction as an open one that gives the nose nothing)
+    sample_t *k = tract->junction_gamma;
+    int v = velum_segment(tract);
+    int c = tract->nose_start + tract->nose_length;
+    if(tract->nose_open && !was_open) {
+        // the nose starts off silent
+        size_t size = sizeof(sample_t) * tract->nose_length;
+        memset(tract->left_front + tract->nose_start, 0, size);
+        memset(tract->right_front + tract->nose_start, 0, size);
+        memset(tract->left_back + tract->nose_start, 0, size);
+        memset(tract->right_back + tract->nose_start, 0, size);
+        nose_targets(tract);
+        memcpy(k + tract->nose_start, tract->junction_target + tract->nose_start,
+               sizeof(sample_t) * (tract->nose_length + NOSE_COEFFICIENTS));
+        k[c] = 1 + k[v];
+        k[c + 1] = 1 - k[v];
+        k[c + 2] = 0;
+    } else if(!tract->nose_open && was_open) {
+        k[v] = 1 - k[c + 1];
+    }
+    tract->shape_dirty = 1;
+}
+
+// set the length and start from the resting shape for the target phoneme
+// (or carry on crossfading from the shape its in if it hadnt got there yet)
+// doesnt touch the waves
+void shape_tract(struct Tract *tract, int nsegments) {
+    int old_nsegments = tract->nsegments;
+    int moving = old_nsegments > 0 && tract->fade < 1;
+    if(moving) {
+        blend_profile(tract, tract->profile_spare);
+        stretch_profile(tract->profile_spare, old_nsegments, tract->profile_from, nsegments);
+    }
+
+    tract->nsegments = nsegments;
+
+    // initialize the segments
+    int stop = TONGUE_FRONT * tract->nsegments;
+    for(int i = 0; i < tract->nsegments; i++) {
+        // segments for the front and back buffers
+        struct Segment *f = &(tract->segments_front[i]);
+        struct Segment *b = &(tract->segments_back[i]);
+        // init front buffer
+        f->z = NEUTRAL_Z;
+        f->target_z = NEUTRAL_Z;
+        f->rigidity = i >= stop ? LIPS_RIGIDITY : 1;
+        // init back buffer
+        b->z = NEUTRAL_Z;
+        b->target_z = NEUTRAL_Z;
+        b->rigidity = f->rigidity;
+    }
+
+    // test set the tract shape
+    //segments_front[nsegments-2].z = 10/NEUTRAL_Z;
+
+    // the shape of every phoneme in the map at this length
+    for(int p = 0; p < tract->nprofiles; p++)
+        phoneme_profile(&phoneme_map.phonemes[p], tract->profiles + p * tract->capacity, nsegments);
+    target_profile(tract);
+    if(moving) {
+        tract->fade = 0;
+    } else {
+        memcpy(tract->profile_from, tract->profile_to, sizeof(double) * nsegments);
+        tract->fade = 1;
+    }
+
+    // init the tract shape
+    // the old coefficients were for different segments so theres nothing to ramp from
+    tract->shape_dirty = 1;
+    tract->coefficients_valid = 0;
+    tract->ramping = 0;
+    update_shape(tract, 1);
+    build_network(tract);
+}
+
+void snap_shape(struct Tract *tract) {
+    // not moving, so shape_tract() starts over right where its going
+    tract->fade = 1;
+    shape_tract(tract, tract->nsegments);
+}
+
+// split a length into whole segments and the extra bit the allpasses make up
+// the whole segments only change when the extra bit gets out of range
+// so small wobbles in length never add or take away segments
+// returns the number of whole segments
+int split_length(struct Tract *tract, double desired_length, int nsegments) {
+    double units = desired_length / tract->unit_length;
+    double extra = units - nsegments;
+    if(nsegments < 1 || extra < MIN_EXTRA_LENGTH || extra > MAX_EXTRA_LENGTH) {
+        // right in the middle of the range
+        nsegments = (int)floor(units - (MIN_EXTRA_LENGTH + MAX_EXTRA_LENGTH) / 2 + 0.5);
+        if(nsegments > tract->capacity) nsegments = tract->capacity;
+        if(nsegments < 1) nsegments = 1;
+        extra = units - nsegments;
+        if(extra < MIN_EXTRA_LENGTH) extra = MIN_EXTRA_LENGTH;
+        if(extra > MAX_EXTRA_LENGTH) extra = MAX_EXTRA_LENGTH;
+    }
+    tract->extra_length = extra;
+    tract->tract_length = (nsegments + extra) * tract->unit_length;
+    tract->lips_allpass_target = allpass_coefficient(extra);
+    return nsegments;
+}
+
+// initialize the vocal tract given a sample rate and a desired length in cm
+void init_tract(struct Tract *tract, int sample_rate, double desired_length) {
+
+    // sampling rate is whatever the driver (jack or offline renderer) runs at
+    tract->rate = sample_rate;
+
+    // pick the fastest way of scattering this cpu can do
+    // (or whatever NANCEALOID_KERNEL says to use)
+    if(scatter_kernel == NULL) {
+        const char *name = getenv("NANCEALOID_KERNEL");
+        if(select_scatter_kernel(name)) {
+            fprintf(stderr, "scatter kernel %s isnt available, using the fastest one\n", name);
+            select_scatter_kernel(NULL);
+        }
+    }
+
+    // get length of a single segment of the waveguide in cm
+    tract->unit_length = (double)SPEED_OF_SOUND / tract->rate;
+
+    // allocate everything once, big enough for the longest tract the
+    // length controller can ask for, so resizing never has to allocate
+    double longest = desired_length > CONTROLLER_TRACT_LENGTH_MAX ? desired_length : CONTROLLER_TRACT_LENGTH_MAX;
+    tract->capacity = (int)(longest / tract->unit_length - MIN_EXTRA_LENGTH) + 1;
+    if(tract->capacity < 1) tract->capacity = 1;
+
+    // and the nose after it
+    tract->nose_start = tract->capacity;
+    tract->nose_length = (int)(NOSE_LENGTH / tract->unit_length + 0.5);
+    if(tract->nose_length < 2) tract->nose_length = 2;
+    int nwaves = tract->capacity + tract->nose_length;
+
+    tract->buffer1 = malloc(sizeof(struct Segment) * nwaves);
+    tract->buffer2 = malloc(sizeof(struct Segment) * nwaves);
+    int padded = padded_length(nwaves);
+    tract->waves = alloc_samples(padded * 4);
+    int ncoefficients = padded_length(nwaves + NOSE_COEFFICIENTS);
+    tract->junction_gamma = alloc_samples(ncoefficients);
+    tract->junction_target = alloc_samples(ncoefficients);
+    tract->junction_step = alloc_samples(ncoefficients);
+    tract->noise_buffer = alloc_samples(padded * 2 * MAX_CONTROL_PERIOD);
+
+    // the cosine table and the phoneme map (unless one was loaded already)
+    // then room for the shape of every phoneme in it
+    init_phonemes();
+    tract->nprofiles = phoneme_map.nphonemes;
+    tract->profiles = malloc(sizeof(double) * tract->capacity * (tract->nprofiles + 3));
+    if(tract->profiles == NULL) {
+        fprintf(stderr, "could not allocate tract memory\n");
+        exit(1);
+    }
+    tract->profile_from = tract->profiles + tract->capacity * tract->nprofiles;
+    tract->profile_free = tract->profile_from + tract->capacity;
+    tract->profile_spare = tract->profile_free + tract->capacity;
+
+    // setup the front and back buffer pointers
+    tract->segments_front = tract->buffer1;
+    tract->segments_back = tract->buffer2;
+    tract->left_front = tract->waves;
+    tract->right_front = tract->waves + padded;
+    tract->left_back = tract->waves + padded * 2;
+    tract->right_back = tract->waves + padded * 3;
+
+    // the velum starts shut
+    tract->velum = 0;
+    tract->nose_open = 0;
+    shape_nose(tract);
+
+    // get a number of segments and the extra bit that make up the desired length
+    tract->nsegments = 0;
+    shape_tract(tract, split_length(tract, desired_length, 0));
+    tract->lips_allpass = tract->lips_allpass_target;
+    memset(tract->lips_state, 0, sizeof(tract->lips_state));
+
+#ifdef DEBUG_TRACT
+    // test impulse
+    tract->ambient_phoneme.lips_roundedness = 1;
+    shape_tract(tract, tract->nsegments);
+    tract->right_front[0] = 1;
+#endif
+
+    // print some INTERESTING INFORMATION,
+    if(tract->quiet)
+        return;
+    printf("rate = %ihz\n", tract->rate);
+    printf("desired tract length = %fcm\n", desired_length);
+    printf("actual tract length = %fcm\n", tract->tract_length);
+    printf("unit length = %fcm\n", tract->unit_length);
+    printf("num waveguide segments = %i (+ %.3f)\n", tract->nsegments, tract->extra_length);
+    printf("max waveguide segments = %i\n", tract->capacity);
+    printf("nose segments = %i\n", tract->nose_length);
+    printf("scatter kernel = %s\n", scatter_kernel->name);
+}
+
+// safe to call from the audio thread, no allocating or printing
+// cheap enough to do every block for vibrato or whatever
+void resize_tract(struct Tract *tract, double desired_length) {
+    int old_nsegments = tract->nsegments;
+    int nsegments = split_length(tract, desired_length, old_nsegments);
+    if(nsegments == old_nsegments)
+        return; // the allpasses ramp to the new length on their own
+
+    // keep the waves that are already in the tract to avoid artifacts
+    // and start any new segments off silent
+    if(nsegments > old_nsegments) {
+        size_t size = sizeof(sample_t) * (nsegments - old_nsegments);
+        memset(tract->left_front + old_nsegments, 0, size);
+        memset(tract->right_front + old_nsegments, 0, size);
+        memset(tract->left_back + old_nsegments, 0, size);
+        memset(tract->right_back + old_nsegments, 0, size);
+    }
+
+    shape_tract(tract, nsegments);
+    tract->lips_allpass = tract->lips_allpass_target;
+}
+
+void clear_tract(struct Tract *tract) {
+    memset(tract->waves, 0, sizeof(sample_t) * padded_length(tract->capacity + tract->nose_length) * 4);
+    memset(tract->lips_state, 0, sizeof(tract->lips_state));
+}
+
+// how big the arrays of a tract are
+static int tract_waves(const struct Tract *tract) {
+    return tract->capacity + tract->nose_length;
+}
+
+static int tract_coefficients(const struct Tract *tract) {
+    return padded_length(tract_waves(tract) + NOSE_COEFFICIENTS);
+}
+
+static int tract_profiles(const struct Tract *tract) {
+    return tract->capacity * (tract->nprofiles + 3);
+}
+
+int init_snapshot(struct TractSnapshot *snapshot, const struct Tract *tract) {
+    memset(snapshot, 0, sizeof(struct TractSnapshot));
+    snapshot->state = *tract;
+    snapshot->segments = malloc(sizeof(struct Segment) * tract_waves(tract) * 2);
+    snapshot->waves = alloc_samples(padded_length(tract_waves(tract)) * 4);
+    snapshot->coefficients = alloc_samples(tract_coefficients(tract) * 3);
+    snapshot->profiles = malloc(sizeof(double) * tract_profiles(tract));
+    return snapshot->segments && snapshot->profiles ? 0 : -1;
+}
+
+void free_snapshot(struct TractSnapshot *snapshot) {
+    free(snapshot->segments);
+    free(snapshot->waves);
+    free(snapshot->coefficients);
+    free(snapshot->profiles);
+    snapshot->segments = NULL;
+    snapshot->waves = snapshot->coefficients = NULL;
+    snapshot->profiles = NULL;
+    snapshot->saved = 0;
+}
+
+void save_tract(const struct Tract *tract, struct TractSnapshot *snapshot) {
+    int nwaves = tract_waves(tract), ncoefficients = tract_coefficients(tract);
+    snapshot->state = *tract;
+    snapshot->front_first = tract->segments_front == tract->buffer1;
+    snapshot->left_front = tract->left_front - tract->waves;
+    snapshot->right_front = tract->right_front - tract->waves;
+    snapshot->left_back = tract->left_back - tract->waves;
+    snapshot->right_back = tract->right_back - tract->waves;
+    snapshot->profile_to = tract->profile_to - tract->profiles;
+    memcpy(snapshot->segments, tract->segments_front, sizeof(struct Segment) * nwaves);
+    memcpy(snapshot->segments + nwaves, tract->segments_back, sizeof(struct Segment) * nwaves);
+    memcpy(snapshot->waves, tract->waves, sizeof(sample_t) * padded_length(nwaves) * 4);
+    memcpy(snapshot->coefficients, tract->junction_gamma, sizeof(sample_t) * ncoefficients);
+    memcpy(snapshot->coefficients + ncoefficients, tract->junction_target, sizeof(sample_t) * ncoefficients);
+    memcpy(snapshot->coefficients + ncoefficients * 2, tract->junction_step, sizeof(sample_t) * ncoefficients);
+    memcpy(snapshot->profiles, tract->profiles, sizeof(double) * tract_profiles(tract));
+    snapshot->saved = 1;
+}
+
+int restore_tract(struct Tract *tract, const struct TractSnapshot *snapshot) {
+    const struct Tract *state = &snapshot->state;
+    if(!snapshot->saved || state->rate != tract->rate || state->capacity != tract->capacity ||
+       state->nose_length != tract->nose_length || state->nprofiles != tract->nprofiles)
+        return -1;
+
+    // the state but keep this tracts own memory (and whether its talking)
+    struct Tract own = *tract;
+    *tract = *state;
+    tract->quiet = own.quiet;
+    tract->timing = own.timing;
+    tract->shape_ns = own.shape_ns;
+    tract->buffer1 = own.buffer1;
+    tract->buffer2 = own.buffer2;
+    tract->waves = own.waves;
+    tract->junction_gamma = own.junction_gamma;
+    tract->junction_target = own.junction_target;
+    tract->junction_step = own.junction_step;
+    tract->noise_buffer = own.noise_buffer;
+    tract->profiles = own.profiles;
+    tract->profile_from = own.profile_from;
+    tract->profile_free = own.profile_free;
+    tract->profile_spare = own.profile_spare;
+
+    // pointing to the same places in this one as they did in the one it came from
+    tract->profile_to = tract->profiles + snapshot->profile_to;
+    tract->target_phoneme = &tract->ambient_phoneme;
+    tract->segments_front = snapshot->front_first ? tract->buffer1 : tract->buffer2;
+    tract->segments_back = snapshot->front_first ? tract->buffer2 : tract->buffer1;
+    tract->left_front = tract->waves + snapshot->left_front;
+    tract->right_front = tract->waves + snapshot->right_front;
+    tract->left_back = tract->waves + snapshot->left_back;
+    tract->right_back = tract->waves + snapshot->right_back;
+
+    int nwaves = tract_waves(tract), ncoefficients = tract_coefficients(tract);
+    memcpy(tract->segments_front, snapshot->segments, sizeof(struct Segment) * nwaves);
+    memcpy(tract->segments_back, snapshot->segments + nwaves, sizeof(struct Segment) * nwaves);
+    memcpy(tract->waves, snapshot->waves, sizeof(sample_t) * padded_length(nwaves) * 4);
+    memcpy(tract->junction_gamma, snapshot->coefficients, sizeof(sample_t) * ncoefficients);
+    memcpy(tract->junction_target, snapshot->coefficients + ncoefficients, sizeof(sample_t) * ncoefficients);
+    memcpy(tract->junction_step, snapshot->coefficients + ncoefficients * 2, sizeof(sample_t) * ncoefficients);
+    memcpy(tract->profiles, snapshot->profiles, sizeof(double) * tract_profiles(tract));
+    return 0;
+}
+
+void free_tract(struct Tract *tract) {
+    free(tract->buffer1);
+    free(tract->buffer2);
+    free(tract->waves);
+    free(tract->junction_gamma);
+    free(tract->junction_target);
+    free(tract->junction_step);
+    free(tract->noise_buffer);
+    free(tract->profiles);
+    tract->profiles = tract->profile_from = tract->profile_free = tract->profile_spare = NULL;
+    tract->profile_to = NULL;
+    tract->noise_buffer = NULL;
+    tract->waves = NULL;
+    tract->junction_gamma = tract->junction_target = tract->junction_step = NULL;
+    tract->segments_front = NULL;
+    tract->segments_back = NULL;
+    tract->left_front = tract->right_front = tract->left_back = tract->right_back = NULL;
+}
+
+void debug_tract(struct Tract *tract, struct Segment *front, struct Segment *back) {
+    for(int i = 0; i < tract->nsegments; i++) {
+        struct Segment f = front[i];
+        printf("SEG#%02d:\tZ=%2.2f\tTZ=%2.2f\tR=%2.2f\t\tL=%2.2f\tR=%2.2f\t\tL=%2.2f\tR=%2.2f\n", i, f.z, f.target_z, f.rigidity, tract->left_front[i], tract->right_front[i], tract->left_back[i], tract->right_back[i]);
+    }
+}
+
+// calculate a reflection coefficient
+// given source impedence and target impedence
+double reflection(double source_z, double target_z) {
+    return (target_z - source_z) / (target_z + source_z);
+}
+
+// first order allpass, state is the last input and the last output
+static inline sample_t allpass(sample_t a, sample_t *state, sample_t x) {
+    sample_t y = a * x + state[0] - a * state[1];
+    state[0] = x;
+    state[1] = y;
+    return y;
+}
+
+// run the vocal tract for the length of a single sample
+// given the sample for the glottal source
+// return the tract out
+sample_t run_tract(struct Tract *tract, sample_t glottal_source) {
+
+    // front buffer is the "old" buffer
+    // back buffer is where the changes get written
+    // after calculating the changes the buffers are swapped
+    // so the changes are "put into effect"
+
+    // sound exiting the mouth
+    sample_t drain = 0;
+
+    // a row of noise for this sample laid out like the block paths make it
+    // (left then right, one for every junction) so a seed sounds the same whichever path runs
+    sample_t *noise_left = tract->noise_buffer;
+    sample_t *noise_right = noise_left + padded_length(tract->nsegments);
+    if(tract->frication)
+        fill_tract_noise(tract, 1);
+
+    // initialize the new buffer
+    for(int i = 0; i < tract->nsegments; i++) {
+        struct Segment *old = &(tract->segments_front[i]);
+        struct Segment *new = &(tract->segments_back[i]);
+        new->target_z = old->target_z;
+        new->rigidity = old->rigidity;
+        tract->left_back[i] = 0;
+        tract->right_back[i] = 0;
+        
+        // calculate physical deformations
+        double old_area = 1 / old->z;
+        double target_area = 1 / new->target_z;
+        double delta = target_area - old_area;
+        double new_area = old_area + delta * PHYSICAL_DAMPING;
+        if (new_area < 0) new_area = MIN_AREA;
+        new->z = 1 / new_area;
+    }
+
+    // process each segment
+    for(int i = 0; i < tract->nsegments; i++) {
+        struct Segment *old = &(tract->segments_front[i]);
+        struct Segment *new = &(tract->segments_back[i]);
+
+        // physical compression of the tract walls due to sound pressure
+        double area = 1/new->z;
+
+        // process audio moving right (toward lips)
+        // if i == 0 then this is at the glottis
+        if(i == 0) {
+            // make the glottis reflect all sound
+            // also mix in the glottal source
+            // normalize source for drain impedence
+            double gamma = 1-reflection(DRAIN_Z, old->z);
+            tract->right_back[i] += tract->left_front[i] * (1-tract->damping) + glottal_source * gamma + tract->diaphram_pressure;
+        } else {
+            // otherwise the new right moving energy is right moving energy to the old left
+            struct Segment *old_left = &(tract->segments_front[i-1]);
+            double gamma = reflection(old_left->z, old->z);
+
+            sample_t reflection = tract->right_front[i-1] * gamma;
+            tract->right_back[i] += tract->right_front[i-1] - reflection;
+            tract->left_back[i-1] += reflection * (1-tract->damping);
+            
+            // frication
+            // due to wind hitting obstruction (increase in impedence)
+            if(tract->frication) {
+                double velocity = reflection;
+                if (velocity < 0) velocity = 0;
+                tract->left_back[i-1] += tract->frication * velocity * noise_left[i];
+            }
+
+            // physical compression of the tract walls due to sound pressure
+            //double tmp = area;
+            area += reflection * (1-old->rigidity);
+            //printf("%f->%f, %f, %f\n", tmp, area, reflection, old->rigidity);
+        }
+
+        // process audio moving left (towarard glottis)
+        if(i == tract->nsegments-1) {
+            // the new left moving energy at the lips is the reflection from the opening
+            // past the extra bit of length on the way out and again on the way back
+            double gamma = reflection(old->z, DRAIN_Z);
+            tract->lips_allpass = tract->lips_allpass_target;
+            sample_t out_wave = allpass(tract->lips_allpass, tract->lips_state, tract->right_front[i]);
+            sample_t reflection = out_wave * gamma;
+            drain = out_wave - reflection;
+            tract->left_back[i] += allpass(tract->lips_allpass, tract->lips_state + 2, reflection * (1-tract->damping));
+
+            // physical compression of the tract walls due to sound pressure
+            area += reflection * (1-old->rigidity);
+
+        } else {
+            // otherwise the new left moving energy is left moving energy to the old right
+            struct Segment *old_right = &(tract->segments_front[i+1]);
+            double gamma = reflection(old_right->z, old->z);
+            sample_t reflection = tract->left_front[i+1] * gamma;
+            tract->left_back[i] += tract->left_front[i+1] - reflection;
+            tract->right_back[i+1] += reflection * (1-tract->damping);
+
+            // frication
+            // due to wind hitting obstruction (increase in impedence)
+            if(tract->frication) {
+                double velocity = reflection;
+                if (velocity < 0) velocity = 0;
+                tract->right_back[i+1] += tract->frication * velocity * noise_right[i+1];
+            }
+
+            // physical compression of the tract walls due to sound pressure
+            area += reflection * (1-old->rigidity);
+        }
+
+        // physical compression of the tract walls due to sound pressure
+        if (area < 0) area = MIN_AREA;
+        new->z = 1/area;
+    }
+
+    // swap waveguide buffers
+    swap_buffers(tract);
+
+    // the walls moved so the block path needs new coefficients
+    tract->shape_dirty = 1;
+
+    // crossfade the shape torward target phoneme
+    advance_tract(tract, 1);
+
+#ifdef DEBUG_TRACT
+    // list the state of all the segments
+    printf("\n\nDEBUG:\n\n");
+    debug_tract(tract, tract->segments_front, tract->segments_back);
+#endif
+
+    // return the output of the mouth
+    return drain;
+}
+
+// move the tract walls toward the target shape
+// this is the same deformation run_tract() does every sample
+// the block path only does it at control rate
+// and then only when the shape has changed
+void reshape_tract(struct Tract *tract) {
+    tract->shape_dirty = 0;
+    for(int i = 0; i < tract->nsegments; i++) {
+        struct Segment *f = &(tract->segments_front[i]);
+        struct Segment *b = &(tract->segments_back[i]);
+        double old_area = 1 / f->z;
+        double target_area = 1 / f->target_z;
+        double delta = target_area - old_area;
+        double new_area = old_area + delta * PHYSICAL_DAMPING;
+        if (new_area < 0) new_area = MIN_AREA;
+
+        // close enough counts as there (otherwise roundoff would keep it going forever)
+        // if its not there yet keep going next time
+        if(fabs(new_area - target_area) <= target_area * SHAPE_EPSILON) {
+            f->z = f->target_z;
+        } else {
+            f->z = 1 / new_area;
+            tract->shape_dirty = 1;
+        }
+
+        // keep both buffers the same shape so swapping doesnt matter
+        b->z = f->z;
+        b->target_z = f->target_z;
+        b->rigidity = f->rigidity;
+    }
+
+    // and recalculate all the reflection coefficients for the new shape
+    // (start_span() ramps to them)
+    for(int j = 1; j < tract->nsegments; j++)
+        tract->junction_target[j] = reflection(tract->segments_front[j-1].z, tract->segments_front[j].z);
+    tract->glottis_gain_target = 1 - reflection(DRAIN_Z, tract->segments_front[0].z);
+    tract->lips_gamma_target = reflection(tract->segments_front[tract->nsegments-1].z, DRAIN_Z);
+    if(tract->nose_open)
+        nose_targets(tract);
+}
+
+void fill_tract_noise(struct Tract *tract, int n) {
+    fill_noise(&tract->noise, tract->noise_buffer, padded_length(tract->nsegments) * 2 * n);
+}
+
+// move the crossfade along as if it went a sample at a time for n samples
+// once its got there theres nothing to do until the target changes
+void advance_tract(struct Tract *tract, int n) {
+    if(!tract->interpolation)
+        return;
+    if(!same_phoneme(tract->target_phoneme, &tract->to_phoneme))
+        retarget_shape(tract);
+    else if(tract->fade == 1)
+        return;
+
+    uint64_t start = tract->timing ? clock_ns() : 0;
+    tract->fade = 1 - (1 - tract->fade) * pow(1 - tract->interpolation_drag, n);
+    // close enough counts as there
+    if(1 - tract->fade <= PHONEME_EPSILON)
+        tract->fade = 1;
+    update_shape(tract, 0);
+    if(tract->timing)
+        tract->shape_ns += clock_ns() - start;
+}
+
+void set_control_period(struct Tract *tract, int period) {
+    if(period < MIN_CONTROL_PERIOD) period = MIN_CONTROL_PERIOD;
+    if(period > MAX_CONTROL_PERIOD) period = MAX_CONTROL_PERIOD;
+    tract->control_period = period;
+}
+
+int start_span(struct Tract *tract, int n) {
+    // the extra length always ramps, but thats cheap
+    tract->lips_allpass_step = (tract->lips_allpass_target - tract->lips_allpass) / n;
+
+    if(!tract->shape_dirty)
+        return 0;
+    uint64_t start = tract->timing ? clock_ns() : 0;
+    reshape_tract(tract);
+
+    int ncoefficients = tract->ncoefficients;
+    if(!tract->coefficients_valid) {
+        // nothing sensible to ramp from, just start at the new shape
+        memcpy(tract->junction_gamma, tract->junction_target, sizeof(sample_t) * ncoefficients);
+        tract->glottis_gain = tract->glottis_gain_target;
+        tract->lips_gamma = tract->lips_gamma_target;
+        tract->coefficients_valid = 1;
+    } else {
+        // get from the last shape to this one by the end of the span
+        for(int j = 1; j < ncoefficients; j++)
+            tract->junction_step[j] = (tract->junction_target[j] - tract->junction_gamma[j]) / n;
+        tract->glottis_gain_step = (tract->glottis_gain_target - tract->glottis_gain) / n;
+        tract->lips_gamma_step = (tract->lips_gamma_target - tract->lips_gamma) / n;
+        tract->ramping = 1;
+    }
+    if(tract->timing)
+        tract->shape_ns += clock_ns() - start;
+    return 1;
+}
+
+void time_tract(struct Tract *tract, int on) {
+    tract->timing = on;
+    tract->shape_ns = 0;
+}
+
+void finish_span(struct Tract *tract, int n) {
+    // step by step adding doesnt quite get there, so jump the last little bit
+    if(tract->ramping) {
+        memcpy(tract->junction_gamma, tract->junction_target, sizeof(sample_t) * tract->ncoefficients);
+        tract->glottis_gain = tract->glottis_gain_target;
+        tract->lips_gamma = tract->lips_gamma_target;
+        tract->ramping = 0;
+    }
+    tract->lips_allpass = tract->lips_allpass_target;
+    advance_tract(tract, n);
+}
+
+// scatter the waves at a junction of a few tubes
+// whatever arrives gets shared out by the weights (2 * the tubes area / all of them)
+// with the bit going back where it came from damped like any other reflection
+// (with 2 ports this is exactly what the scatter kernels do)
+static inline void scatter_split(const struct Split *split,
+                                 const sample_t *old_left, const sample_t *old_right,
+                                 sample_t *new_left, sample_t *new_right,
+                                 const sample_t *k, sample_t atten) {
+    sample_t x[MAX_PORTS];
+    sample_t sum = 0;
+    for(int p = 0; p < split->nports; p++) {
+        int s = split->segment[p];
+        x[p] = split->side[p] == END_LEFT ? old_left[s] : old_right[s];
+        sum += x[p];
+    }
+    for(int p = 0; p < split->nports; p++) {
+        int s = split->segment[p];
+        sample_t w = k[split->coefficient + p];
+        sample_t y = w * (sum - x[p]) + atten * (w - 1) * x[p];
+        if(split->side[p] == END_LEFT)
+            new_right[s] = y;
+        else
+            new_left[s] = y;
+    }
+}
+
+// run the tract for a stretch of samples between shape updates
+// (at most control_period samples)
+void run_tract_span(struct Tract *tract, const sample_t *in, sample_t *out, int n) {
+    start_span(tract, n);
+
+    if(tract->fixed) {
+        if(tract->frication)
+            tract->fixed->frication(tract, in, out, n);
+        else
+            tract->fixed->scatter(tract, in, out, n);
+        finish_span(tract, n);
+        return;
+    }
+
+    // everything that stays the same for the whole span
+    // (unless the shape is ramping, then the coefficients move a bit every sample)
+    sample_t *k = tract->junction_gamma;
+    const sample_t *k_step = tract->junction_step;
+    int ramping = tract->ramping;
+    sample_t glottis_gain = tract->glottis_gain;
+    sample_t lips_gamma = tract->lips_gamma;
+    int ncoefficients = tract->ncoefficients;
+    const struct Schedule *schedule = &tract->schedule;
+    int glottis = schedule->glottis;
+    int lips = schedule->lips;
+    sample_t atten = 1 - tract->damping;
+    sample_t pressure = tract->diaphram_pressure;
+    sample_t fric = tract->frication;
+    sample_t *old_left = tract->left_front, *old_right = tract->right_front;
+    sample_t *new_left = tract->left_back, *new_right = tract->right_back;
+
+    // the extra length ramps to where its going over the span
+    sample_t lips_allpass = tract->lips_allpass;
+    sample_t lips_step = tract->lips_allpass_step;
+    sample_t lips_state[4];
+    memcpy(lips_state, tract->lips_state, sizeof(lips_state));
+
+    // make all the noise for the span in one go
+    int padded = padded_length(tract->nsegments);
+    if(fric)
+        fill_tract_noise(tract, n);
+
+    for(int t = 0; t < n; t++) {
+        // the glottis reflects everything and mixes in the source
+        new_right[glottis] = old_left[glottis] * atten + in[t] * glottis_gain + pressure;
+
+        // every new wave comes from exactly one junction
+        // so theres no need to clear the new buffer first
+        // (a single run from the glottis to the lips unless the nose is open)
+        for(int i = 0; i < schedule->nruns; i++) {
+            const struct Run *run = &schedule->runs[i];
+            int o = run->start;
+            if(fric && run->fricative) {
+                sample_t *noise_left = tract->noise_buffer + padded * 2 * t;
+                sample_t *noise_right = noise_left + padded;
+                scatter_frication(old_left + o, old_right + o, new_left + o, new_right + o, k + o, atten,
+                                  noise_left + o, noise_right + o, fric, run->n);
+            } else
+                scatter_kernel->scatter(old_left + o, old_right + o, new_left + o, new_right + o, k + o, atten, run->n);
+        }
+
+        // the junctions where tubes branch off
+        for(int i = 0; i < schedule->nsplits; i++)
+            scatter_split(&schedule->splits[i], old_left, old_right, new_left, new_right, k, atten);
+
+        // the lips let some out and reflect the rest
+        // going through the extra bit of length on the way out and back
+        sample_t r = allpass(lips_allpass, lips_state, old_right[lips]);
+        sample_t reflected = r * lips_gamma;
+        new_left[lips] = allpass(lips_allpass, lips_state + 2, reflected * atten);
+        out[t] = r - reflected;
+        lips_allpass += lips_step;
+
+        // and the nostrils (without the extra length)
+        for(int i = 0; i < schedule->nopenings; i++) {
+            const struct Opening *opening = &schedule->openings[i];
+            sample_t x = old_right[opening->segment];
+            sample_t back = x * k[opening->coefficient];
+            new_left[opening->segment] = back * atten;
+            out[t] += x - back;
+        }
+
+        if(ramping) {
+            for(int j = 1; j < ncoefficients; j++)
+                k[j] += k_step[j];
+            glottis_gain += tract->glottis_gain_step;
+            lips_gamma += tract->lips_gamma_step;
+        }
+
+        sample_t *tmp = old_left;
+        old_left = new_left;
+        new_left = tmp;
+        tmp = old_right;
+        old_right = new_right;
+        new_right = tmp;
+    }
+
+    tract->left_front = old_left;
+    tract->right_front = old_right;
+    tract->left_back = new_left;
+    tract->right_back = new_right;
+    memcpy(tract->lips_state, lips_state, sizeof(lips_state));
+
+    finish_span(tract, n);
+}
+
+// run the vocal tract for a whole block of samples
+// unlike run_tract() the shape is only updated every control_period samples
+// and in between its just waves bouncing around with coefficients ramping from one shape to the next
+void run_tract_block(struct Tract *tract, const sample_t *in, sample_t *out, int nframes) {
+    int period = tract->control_period;
+    for(int start = 0; start < nframes; start += period) {
+        int n = nframes - start < period ? nframes - start : period;
+        run_tract_span(tract, in + start, out + start, n);
+    }
+}
+
+int silent_block(const sample_t *in, int n) {
+    for(int i = 0; i < n; i++)
+        if(in[i] != 0)
+            return 0;
+    return 1;
+}
+
+int skip_tract(struct Tract *tract, int silent, int n) {
+    if(!tract->asleep)
+        return 0;
+    if(!silent || tract->diaphram_pressure != 0) {
+        tract->asleep = 0;
+        return 0;
+    }
+    // keep the shape where it would be so it wakes up in the right one
+    tract->lips_allpass = tract->lips_allpass_target;
+    advance_tract(tract, n);
+    return 1;
+}
+
+// how much is still bouncing around in the tract
+double wave_energy(struct Tract *tract) {
+    double energy = 0;
+    for(int i = 0; i < tract->nsegments; i++)
+        energy += tract->left_front[i] * tract->left_front[i] + tract->right_front[i] * tract->right_front[i];
+    for(int i = tract->nose_start; tract->nose_open && i < tract->nose_start + tract->nose_length; i++)
+        energy += tract->left_front[i] * tract->left_front[i] + tract->right_front[i] * tract->right_front[i];
+    for(int i = 0; i < 4; i++)
+        energy += tract->lips_state[i] * tract->lips_state[i];
+    return energy;
+}
+
+void settle_tract(struct Tract *tract, int silent) {
+    if(silent && tract->diaphram_pressure == 0 && wave_energy(tract) < IDLE_ENERGY) {
+        // start from exact silence when it wakes up
+        clear_tract(tract);
+        tract->asleep = 1;
+    }
+}
+
+uint64_t flush_denormals() {
+#if defined(__x86_64__) || defined(__i386__)
+    // flush to zero and denormals are zero
+    uint64_t csr = _mm_getcsr();
+    _mm_setcsr(csr | 0x8040);
+    return csr;
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    __asm__ volatile("msr fpcr, %0" :: "r"(fpcr | (1 << 24)));
+    return fpcr;
+#else
+    return 0;
+#endif
+}
+
+void restore_denormals(uint64_t mode) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_setcsr(mode);
+#elif defined(__aarch64__)
+    __asm__ volatile("msr fpcr, %0" :: "r"(mode));
+#else
+    (void)mode;
+#endif
+}
+
+// maps a midi controller value to a given range
+double map2range(uint8_t value, double min, double max) {
+    return min + (max - min) * (value / 127.0);
+}
+
+// apply a single raw midi message to the tract
+// this is shared by the jack client and the offline renderer
+// runs on the audio thread so it only talks through the realtime log
+void handle_midi(struct Tract *tract, const uint8_t *buffer, size_t size) {
+    // every message we care about is a 3 byte channel message
+    if(size < 3)
+        return;
+
+    uint8_t type = buffer[0] & 0xf0;
+    uint8_t chan = buffer[0] & 0x0f;
+
+    // control signal
+    if(type == 0xb0) {
+        uint8_t id = buffer[1];
+        uint8_t value = buffer[2];
+        //printf("  midi control change event: 0x%x, 0x%x\n", id, value);
+
+        if(id==CONTROLLER_TRACT_LENGTH) {
+            double desired_length = map2range(value, CONTROLLER_TRACT_LENGTH_MIN, CONTROLLER_TRACT_LENGTH_MAX);
+            resize_tract(tract, desired_length);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting tract length to desired %2.2fcm...actually got %2.2fcm\n", desired_length, tract->tract_length);
+        }
+        else if(id==CONTROLLER_TONGUE_HEIGHT) {
+            //ambient_phoneme.tongue_height = map2range(value, 0, 0.9);
+            tract->ambient_phoneme.tongue_height = map2range(value, 0, 1);
+            //update_shape(1);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting ambient tongue height to %2.2f%%..\n", tract->ambient_phoneme.tongue_height*100);
+        }
+        else if(id==CONTROLLER_TONGUE_POSITION) {
+            tract->ambient_phoneme.tongue_position = map2range(value, 0, 1);
+            //update_shape(1);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting ambient tongue frontness to %2.2f%%..\n", tract->ambient_phoneme.tongue_position*100);
+        }
+        else if(id==CONTROLLER_LIPS_ROUNDEDNESS) {
+            //ambient_phoneme.lips_roundedness = map2range(value, 0, 0.9);
+            tract->ambient_phoneme.lips_roundedness = map2range(value, 0, 1);
+            //update_shape(1);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting ambient lips roundedness to %2.2f%%..\n", tract->ambient_phoneme.lips_roundedness*100);
+        }
+        else if(id==CONTROLLER_DRAG) {
+            tract->interpolation_drag = map2range(value, DRAG_MIN, DRAG_MAX);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting interpolation drag to %.5f..\n", tract->interpolation_drag);
+        }
+        else if(id==CONTROLLER_PRESSURE) {
+            tract->diaphram_pressure = map2range(value, MIN_DIAPHRAM_PRESSURE, MAX_DIAPHRAM_PRESSURE);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting continuous air pressure from lungs to %.3f..\n", tract->diaphram_pressure);
+        }
+        else if(id==CONTROLLER_DAMPING) {
+            tract->damping = map2range(value, MIN_DAMPING, MAX_DAMPING);
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "setting damping to %.3f..\n", tract->damping);
+        }
+        else if(id==CONTROLLER_VELUM) {
+            set_velum(tract, map2range(value, 0, 1));
+            if(!tract->quiet)
+                rt_log(LOG_EVENTS, "opening the velum %2.2f%%..\n", tract->velum*100);
+        }
+    }
+    else if(type == 0x80 && chan == PHONEME_CHANNEL) {
+        //uint8_t note = buffer[1];
+        //uint8_t velocity = buffer[2];
+        //printf("  [chan %02d] midi note OFF: 0x%x, 0x%x\n", chan, note, velocity);
+        //struct Phoneme *phoneme = get_mapped_phoneme(note);
+        //if (target_phoneme == phoneme) {
+        //    // TODO: a stack of notes to return to
+        //    target_phoneme = &ambient_phoneme;
+        //}
+    }
+    else if(type == 0x90 && chan == PHONEME_CHANNEL) {
+        uint8_t note = buffer[1];
+        uint8_t velocity = buffer[2];
+        if(!tract->quiet)
+            rt_log(LOG_EVENTS, "  [chan %02d] midi note ON:  0x%x, 0x%x\n", chan, note, velocity);
+        //target_phoneme = get_mapped_phoneme(note);
+        tract->ambient_phoneme = *get_mapped_phoneme(tract, note);
+
+        //// TMP: insert plosive transient
+        //if(note == 0x30) {
+        //    segments_front[nsegments-1].right += diaphram_pressure;
+        //}
+    }
+}
+
+// clamp a control value into the range its midi controller covers
+// anything can be on the other end of the queue so nan comes out as min too
+static double clamp_control(double value, double min, double max) {
+    if(min > max) {
+        double tmp = min;
+        min = max;
+        max = tmp;
+    }
+    return !(value >= min) ? min : value > max ? max : value;
+}
+
+// the same as the controllers in handle_midi() but in real units
+// controllers can send thousands of these a second so they dont get logged
+void control_tract(struct Tract *tract, const struct ControlEvent *event) {
+    switch(event->type) {
+        case CONTROL_PHONEME:
+            tract->ambient_phoneme.tongue_height = clamp_control(event->phoneme.tongue_height, 0, 1);
+            tract->ambient_phoneme.tongue_position = clamp_control(event->phoneme.tongue_position, 0, 1);
+            tract->ambient_phoneme.lips_roundedness = clamp_control(event->phoneme.lips_roundedness, 0, 1);
+            break;
+        case CONTROL_LENGTH:
+            resize_tract(tract, clamp_control(event->value, CONTROLLER_TRACT_LENGTH_MIN, CONTROLLER_TRACT_LENGTH_MAX));
+            break;
+        case CONTROL_PRESSURE:
+            tract->diaphram_pressure = clamp_control(event->value, MIN_DIAPHRAM_PRESSURE, MAX_DIAPHRAM_PRESSURE);
+            break;
+        case CONTROL_DAMPING:
+            tract->damping = clamp_control(event->value, MIN_DAMPING, MAX_DAMPING);
+            break;
+        case CONTROL_DRAG:
+            tract->interpolation_drag = clamp_control(event->value, DRAG_MIN, DRAG_MAX);
+            break;
+        case CONTROL_VELUM:
+            set_velum(tract, clamp_control(event->value, 0, 1));
+            break;
+    }
+}
+
+// start the frication noise from a particular seed
+// the same seed and the same input always make the same output
+void seed_tract(struct Tract *tract, uint32_t seed) {
+    seed_noise(&tract->noise, seed);
+}
+
+// set the default parameters and build a tract at the given sample rate
+void setup_tract(struct Tract *tract, int sample_rate) {
+    tract->ambient_phoneme.tongue_height = 0;
+    tract->ambient_phoneme.tongue_position = 0.5;
+    tract->ambient_phoneme.lips_roundedness = 0;
+    tract->target_phoneme = &tract->ambient_phoneme;
+    tract->interpolation_drag = DEFAULT_INTERPOLATION_DRAG;
+    tract->diaphram_pressure = 0;
+    tract->damping = DEFAULT_DAMPING;
+    tract->frication = FRICATION;
+    tract->interpolation = 1;
+    tract->control_period = CONTROL_PERIOD;
+    tract->asleep = 0;
+    tract->timing = 0;
+    tract->shape_ns = 0;
+    seed_noise(&tract->noise, DEFAULT_NOISE_SEED);
+    init_tract(tract, sample_rate, TRACT_LENGTH);
+}
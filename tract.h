@@ -0,0 +1,345 @@
+/*
+ * nancealoid tract engine
+ *
+ * the 1d digital waveguide vocal tract itself
+ * doesnt know anything about jack so it can be driven by
+ * the jack client or rendered offline as fast as the cpu goes
+ */
+
+#ifndef TRACT_H
+#define TRACT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "noise.h"
+#include "phoneme.h"
+#include "network.h"
+#include "control.h"
+
+struct FixedKernel;
+
+#define SPEED_OF_SOUND 34300    // cm per second
+#define TRACT_LENGTH 17.5       // desired tract length in cm
+#define NEUTRAL_Z 1             // impedence of schwa
+#define THROAT_Z 5              // impedence of throat
+#define DRAIN_Z 0.1             // acoustic impedence at the opening of the lips
+#define MIN_AREA 0.000001       // to avoid divisions by 0 lol
+
+// midi controllers for different functions
+#define CONTROLLER_TONGUE_POSITION 0x15
+#define CONTROLLER_TONGUE_HEIGHT 0x16
+#define CONTROLLER_LIPS_ROUNDEDNESS 0x17
+#define CONTROLLER_TRACT_LENGTH 0x18
+#define CONTROLLER_DRAG 0x19
+#define CONTROLLER_PRESSURE 0x1a
+#define CONTROLLER_DAMPING 0x1b
+#define CONTROLLER_VELUM 0x1c
+
+// controller ranges
+#define CONTROLLER_TRACT_LENGTH_MIN 8
+#define CONTROLLER_TRACT_LENGTH_MAX 24
+
+// tongue start and stop (percentage of tract)
+#define TONGUE_BACK 0.2
+#define TONGUE_FRONT 0.9
+
+// how fast to sitch between phonemes
+#define DEFAULT_INTERPOLATION_DRAG 0.0004
+#define DRAG_MIN 0.001
+#define DRAG_MAX 0.0001
+
+// min and max continuous air pressure from the lungs
+#define MIN_DIAPHRAM_PRESSURE -0.2
+#define MAX_DIAPHRAM_PRESSURE 0.2
+
+// how much acoustic energy is absorbed in collisions
+#define DEFAULT_DAMPING 0.04
+#define MIN_DAMPING 0
+#define MAX_DAMPING 0.2
+
+// default frication multiplier
+#define FRICATION 0.1
+
+// the nose branches off this far along the tract (from the glottis to the lips)
+// and goes this far to the nostrils (in cm)
+#define VELUM_POSITION 0.45
+#define NOSE_LENGTH 11.5
+
+// area of the way into the nose with the velum all the way down
+#define NOSE_PORT_AREA 0.5
+
+// the nose needs the 3 weights of the velum junction and the reflection at the nostrils
+#define NOSE_COEFFICIENTS 4
+
+// TODO: make this actuall work lol NEED ME SOME TRILLS
+// so like, sound pressure can actually reshape the tract
+// and it will oscillate
+// this is the damping factor
+#define PHYSICAL_DAMPING 1
+// and how rigid various parts are
+#define LIPS_RIGIDITY 1
+
+// the tract length past the last whole segment is made up by a pair of allpasses
+// (in segments, the whole segments only change when it gets outside this range)
+#define MIN_EXTRA_LENGTH 0.25
+#define MAX_EXTRA_LENGTH 1.75
+
+// how many samples run_tract_block() goes between tract shape updates
+// (the coefficients ramp from one shape to the next over that long)
+#define CONTROL_PERIOD 32
+#define MIN_CONTROL_PERIOD 16
+#define MAX_CONTROL_PERIOD 64
+
+// how close the walls have to get to the target shape to count as settled
+#define SHAPE_EPSILON 1e-9
+
+// and how close the crossfade to the target phoneme has to get before it stops
+// (after that the shape isnt touched again until the target changes)
+#define PHONEME_EPSILON 1e-5
+
+// a tract with nothing going in and less wave energy than this goes to sleep
+// (about 100db down, see settle_tract())
+#define IDLE_ENERGY 1e-10
+
+// which midi channel to use to map notes to phonemes
+#define PHONEME_CHANNEL 0x9
+
+//#define DEBUG_TRACT
+
+// audio samples are the same as jacks default audio samples
+typedef float sample_t;
+
+// wave arrays are aligned to this many bytes (a cache line)
+#define TRACT_ALIGN 64
+
+// the shape of a waveguide segment
+// the waves traveling through it live in separate arrays (see tract.c)
+struct Segment {
+    double z; // acoustic impedence at this segment (inverse of cross sectional area (i think lol))
+    double target_z; // where it wants to be
+    double rigidity; // 1 = will not move at all
+};
+
+// a whole vocal tract
+// everything it needs to run lives in here so there can be as many as you want
+struct Tract {
+    // tract parameters
+    double interpolation_drag;
+    double diaphram_pressure;
+    double damping;
+    double frication; // frication multiplier, 0 turns the noise off entirely
+    int interpolation; // 0 freezes the tract in its current shape
+    int control_period; // samples between shape updates in run_tract_block()
+    int quiet; // dont print anything (for all but one voice of a choir)
+
+    // vocal tract stuff
+    int rate; // sample rate
+    double unit_length; // length of segment in cm
+    double tract_length; // length of tract in cm (whole segments + extra_length)
+    int nsegments; // number of segments
+    int capacity; // most segments there is room for (see init_tract())
+
+    // "double buffer" the waveguide segments lol
+    struct Segment *segments_front; // front buffer
+    struct Segment *segments_back; // back buffer
+    struct Segment *buffer1;
+    struct Segment *buffer2;
+
+    // the waves traveling left (toward the glottis) and right (toward the lips)
+    // kept in their own contiguous arrays (structure of arrays) so scattering
+    // just streams through memory without dragging the segment shapes along
+    // double buffered just like the segments
+    sample_t *left_front, *right_front; // front buffer
+    sample_t *left_back, *right_back; // back buffer
+    sample_t *waves; // one allocation holding all four
+
+    // cached reflection coefficients for run_tract_block()
+    // junction_gamma[j] is for waves going from segment j-1 into segment j
+    // (waves going the other way see -junction_gamma[j])
+    // when the shape changes they ramp linearly to the new shape over a span
+    // instead of jumping there (no zipper noise)
+    sample_t *junction_gamma; // right now
+    sample_t *junction_target; // what the last reshape came up with
+    sample_t *junction_step; // how much they change every sample of the span
+    sample_t glottis_gain, glottis_gain_target, glottis_gain_step; // how much of the glottal source gets into the tract
+    sample_t lips_gamma, lips_gamma_target, lips_gamma_step; // reflection at the opening of the lips
+    int ramping; // the coefficients are on their way to the target this span
+    int coefficients_valid; // 0 = nothing to ramp from, jump straight to the next shape
+
+    // the fractional end section between the last segment and the lips
+    // an allpass on the way out and another on the way back, delaying extra_length each
+    double extra_length; // in segments
+    sample_t lips_allpass; // allpass coefficient right now
+    sample_t lips_allpass_target; // and where it ramps to over the next span
+    sample_t lips_allpass_step; // by this much every sample
+    sample_t lips_state[4]; // last in and out of the outgoing then the returning allpass
+    int shape_dirty; // the shape changed since the coefficients were calculated
+    int asleep; // silent with nothing going in, so theres no point running it
+
+    // the nose, a tube branching off at the velum
+    // its segments come after the room for the longest tract so resizing never moves them
+    // and its coefficients after that (see network.h for how it all gets run)
+    double velum; // how open the way into the nose is, 0 shuts it off completely
+    int nose_open; // the schedule has the nose in it
+    int nose_start; // first segment of the nose
+    int nose_length; // segments from the velum to the nostrils
+    int ncoefficients; // junction coefficients the block path ramps
+    struct Schedule schedule; // what the block path runs every sample
+    const struct FixedKernel *fixed; // a span made for exactly this network, NULL = run the schedule (see fixed.h)
+
+    // how long the shape updates took (in ns, see time_tract())
+    int timing; // 0 = dont bother looking at the clock
+    uint64_t shape_ns;
+
+    // where the frication noise comes from
+    struct Noise noise;
+    sample_t *noise_buffer; // noise for a whole span (left then right for every sample)
+
+    // phoneme to return to
+    // controlled freely by midi control signals
+    struct Phoneme ambient_phoneme;
+
+    // target phoneme
+    // point it to what you want the phoneme to be
+    // simulation will crossfade towards it
+    struct Phoneme *target_phoneme;
+
+    // the shape the walls are heading for is a crossfade between two area profiles
+    // every phoneme in the map has its profile worked out whenever the length changes
+    // so switching phonemes doesnt need any cosines at all
+    double *profiles; // nprofiles rows of capacity, in the order of phoneme_map
+    int nprofiles;
+    double *profile_from; // the shape the crossfade started from
+    const double *profile_to; // and the one its going to (a row of profiles or profile_free)
+    double *profile_free; // for phonemes that arent in the map (the cc controlled ones)
+    double *profile_spare; // somewhere to stretch the shape when resizing
+    double fade; // 0 = all from, 1 = all to
+    struct Phoneme to_phoneme; // the phoneme profile_to is the shape of
+};
+
+// everything a tract is in the middle of, to pick it back up later
+// (a stuck record of it, with its own copies of the waves, shape and coefficients)
+// it only goes back into a tract built the same way (same rate, capacity and phoneme map)
+struct TractSnapshot {
+    struct Tract state; // its pointers are into the tract it came from, dont follow them
+    int saved; // 0 = nothing in it yet
+    int front_first; // buffer1 was the front segments
+    long left_front, right_front, left_back, right_back; // where they were in waves
+    long profile_to; // and where that was in profiles
+    struct Segment *segments; // front then back
+    sample_t *waves;
+    sample_t *coefficients; // gamma then target then step
+    double *profiles;
+};
+
+// set the default parameters and build a tract at the given sample rate
+void setup_tract(struct Tract *tract, int sample_rate);
+
+// initialize the vocal tract given a sample rate and a desired length in cm
+// makes room for a tract as long as CONTROLLER_TRACT_LENGTH_MAX (or the desired length if longer)
+void init_tract(struct Tract *tract, int sample_rate, double desired_length);
+
+// change the length of the tract keeping the waves that are in it
+// never allocates, so its fine to do from the audio thread
+// (it cant get any longer than it was made room for in init_tract())
+void resize_tract(struct Tract *tract, double desired_length);
+
+void free_tract(struct Tract *tract);
+
+// silence all the waves in the tract (the shape stays)
+void clear_tract(struct Tract *tract);
+
+// make room in a snapshot for the state of tracts built like this one
+// returns 0 on success
+int init_snapshot(struct TractSnapshot *snapshot, const struct Tract *tract);
+void free_snapshot(struct TractSnapshot *snapshot);
+
+// copy everything about a tract into a snapshot, or back out of one into another tract
+// (just memcpys, fine on the audio thread)
+// restoring really is everything, the ambient phoneme, the velum and the length come from the snapshot too
+// (so the choirs warm starts only use one with the same phoneme, velum and segments, see warm_fits())
+// restoring fails with -1 if the tract wasnt built the same way or the snapshot is empty
+void save_tract(const struct Tract *tract, struct TractSnapshot *snapshot);
+int restore_tract(struct Tract *tract, const struct TractSnapshot *snapshot);
+
+// set the number of segments and start over in the resting shape for the target phoneme
+// (doesnt touch the waves, resize_tract() is the one to use while its running)
+void shape_tract(struct Tract *tract, int nsegments);
+
+// start crossfading from the shape its in to the target phoneme
+void retarget_shape(struct Tract *tract);
+
+// move the walls targets to wherever the crossfade has got to (and the walls too if set_z)
+void update_shape(struct Tract *tract, int set_z);
+
+// jump straight to the target phoneme, walls and all, instead of crossfading there
+// (for picking a score up partway through)
+void snap_shape(struct Tract *tract);
+
+// run the vocal tract for the length of a single sample
+sample_t run_tract(struct Tract *tract, sample_t glottal_source);
+
+// run the vocal tract for a block of samples
+// much cheaper than calling run_tract() for each sample
+void run_tract_block(struct Tract *tract, const sample_t *in, sample_t *out, int nframes);
+
+// the pieces run_tract_block() is made of
+// for other kernels that run tracts their own way (see gang.c)
+
+// how many samples to allocate for an array of n samples (whole cache lines)
+int padded_length(int n);
+
+// how many samples run_tract_block() goes between shape updates (clamped to the allowed range)
+void set_control_period(struct Tract *tract, int period);
+
+// get the coefficients ready for a span of n samples (at most control_period)
+// reshapes the tract if it needs it and works out the ramps
+// returns 1 if any of the coefficients or their steps changed
+int start_span(struct Tract *tract, int n);
+
+// after a span of n samples has run, land the ramps on their targets
+// and move the phoneme along
+void finish_span(struct Tract *tract, int n);
+
+// fill noise_buffer with the frication noise for a span of n samples
+void fill_tract_noise(struct Tract *tract, int n);
+
+// keep count of how long the shape updates take in shape_ns (0 stops counting)
+// its a couple of looks at the clock every span the shape moves so its off unless asked for
+void time_tract(struct Tract *tract, int on);
+
+// open the way into the nose, 0 (the default) to 1
+// at 0 the tract is the classic single tube and costs nothing more
+void set_velum(struct Tract *tract, double velum);
+
+// 1 if every sample of a block is exactly 0
+int silent_block(const sample_t *in, int n);
+
+// if the tract is asleep and the next n samples of source are silent (and theres no pressure)
+// just move the shape along and return 1, the tract would only have made zeros
+// otherwise wake it up (if it was asleep) and return 0
+int skip_tract(struct Tract *tract, int silent, int n);
+
+// after running a block with a silent source, put the tract to sleep if it has died away
+void settle_tract(struct Tract *tract, int silent);
+
+// flush denormals to zero on this thread
+// waves dying away get slow on x86 otherwise, do it on every thread that runs tracts
+// returns how the thread was before, for restore_denormals()
+uint64_t flush_denormals();
+
+// put a threads floating point mode back the way flush_denormals() found it
+// (on threads that arent ours, like a plugin hosts)
+void restore_denormals(uint64_t mode);
+
+// start the frication noise from a particular seed
+// the same seed and the same input always make the same output
+void seed_tract(struct Tract *tract, uint32_t seed);
+
+// apply a single raw midi message to the tract
+void handle_midi(struct Tract *tract, const uint8_t *buffer, size_t size);
+
+// apply a single control event to the tract (its time is up to whoever calls this)
+void control_tract(struct Tract *tract, const struct ControlEvent *event);
+
+#endif
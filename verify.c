@@ -0,0 +1,492 @@
+/*
+ * engine verification
+ *
+ * every engine gets two numbers against the reference:
+ * the biggest difference between the waveforms (over the peak of the reference)
+ * and how far apart the average spectra are (rms of the db difference of every bin that matters)
+ * the block paths only update the shape every control period, so theyre allowed to be a little off
+ * (more the longer the period), some scenarios are harder than others so they get a bit extra on top
+ * run_tract() is only ever the one tube so it sits out the ones with the nose open
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "verify.h"
+#include "reference.h"
+#include "tract.h"
+#include "voice.h"
+#include "scatter.h"
+#include "fixed.h"
+#include "governor.h"
+
+// pitch and level of the sawtooth going in
+#define VERIFY_PITCH 110
+#define VERIFY_LEVEL 0.3
+
+// how the scenario starts and what it does while its running
+struct Scenario {
+    char name[32];
+    int source; // a sawtooth going in, otherwise silence
+    int impulse; // start with a click in the tract like DEBUG_TRACT does
+    const struct Phoneme *phoneme; // what it sings (NULL = the ambient one it starts with)
+    int frication; // add wind noise
+    int sweep; // slide the length from one end of the controller to the other
+    int pressure; // keep changing the air pressure instead of a source
+    int velum; // open the nose (1 = and keep it open, 2 = then less, then shut it again)
+    int waveform; // 0 = only the spectrum has to match
+    double max_allowance; // extra on top of every engines tolerances
+    double spectral_allowance;
+};
+
+// ways of running the tract
+#define ENGINE_REFERENCE 0
+#define ENGINE_SAMPLE 1 // run_tract()
+#define ENGINE_BLOCK 2 // run_tract_block()
+#define ENGINE_CHOIR 3 // a choir of identical voices
+
+struct Variant {
+    char name[32];
+    int engine;
+    const struct ScatterKernel *kernel;
+    int generic; // never use the fixed length kernels
+    int period; // control period
+    int nvoices;
+    int nthreads;
+    double max_error; // tolerances, the waveform (relative to the peak)
+    double spectral_error; // and the spectrum (db)
+};
+
+struct Tract verify_tract;
+struct Choir verify_choir;
+
+// get a tract into the starting state for a scenario
+static void setup_scenario(const struct Scenario *scenario, struct Tract *tract) {
+    tract->frication = scenario->frication ? FRICATION : 0;
+    // every voice of a choir makes the same noise so they all sing the same
+    seed_tract(tract, DEFAULT_NOISE_SEED);
+    if(scenario->phoneme)
+        tract->ambient_phoneme = *scenario->phoneme;
+    if(scenario->impulse) {
+        tract->ambient_phoneme.lips_roundedness = 1;
+        shape_tract(tract, tract->nsegments);
+        tract->right_front[0] = 1;
+    }
+}
+
+// whatever the scenario does before the block starting at frame
+static void control_scenario(const struct Scenario *scenario, struct Tract *tract, long frame, long frames) {
+    if(scenario->sweep) {
+        double x = (double)frame / frames;
+        resize_tract(tract, CONTROLLER_TRACT_LENGTH_MIN + (CONTROLLER_TRACT_LENGTH_MAX - CONTROLLER_TRACT_LENGTH_MIN) * x);
+    }
+    if(scenario->pressure) {
+        static const uint8_t values[] = { 0x60, 0x40, 0x10, 0x7f, 0x30 };
+        long step = frame / (VERIFY_RATE / 10);
+        uint8_t cc[] = { 0xb0, CONTROLLER_PRESSURE, values[step % sizeof(values)] };
+        handle_midi(tract, cc, sizeof(cc));
+    }
+    if(scenario->velum) {
+        static const uint8_t values[] = { 0x70, 0x30, 0 };
+        long step = scenario->velum == 2 ? frame * 3 / frames : 0;
+        uint8_t cc[] = { 0xb0, CONTROLLER_VELUM, values[step] };
+        handle_midi(tract, cc, sizeof(cc));
+    }
+}
+
+// render a scenario through one engine
+static void render_variant(const struct Variant *variant, const struct Scenario *scenario, sample_t *out, long frames) {
+    int rate = VERIFY_RATE;
+    int nsource = rate / VERIFY_PITCH;
+    const struct ScatterKernel *kernel = scatter_kernel;
+    if(variant->kernel)
+        scatter_kernel = variant->kernel;
+    fixed_kernels = !variant->generic;
+
+    int nvoices = variant->engine == ENGINE_CHOIR ? variant->nvoices : 1;
+    struct Tract *tracts[MAX_VOICES];
+    if(variant->engine == ENGINE_CHOIR) {
+        init_choir(&verify_choir, nvoices, rate, TRACT_LENGTH);
+        if(variant->nthreads && start_choir_threads(&verify_choir, variant->nthreads, 0)) {
+            fprintf(stderr, "couldnt start voice threads\n");
+            exit(1);
+        }
+        for(int v = 0; v < nvoices; v++) {
+            if(nvoices > 1) {
+                uint8_t note_on[] = { 0x90, 0x30 + v, 0x7f };
+                choir_midi(&verify_choir, note_on, sizeof(note_on));
+            }
+            tracts[v] = &verify_choir.voices[v].tract;
+        }
+    } else {
+        setup_tract(&verify_tract, rate);
+        tracts[0] = &verify_tract;
+    }
+    for(int v = 0; v < nvoices; v++) {
+        set_control_period(tracts[v], variant->period ? variant->period : CONTROL_PERIOD);
+        setup_scenario(scenario, tracts[v]);
+    }
+
+    sample_t in[VERIFY_BLOCK];
+    for(long done = 0; done < frames; done += VERIFY_BLOCK) {
+        int n = frames - done < VERIFY_BLOCK ? frames - done : VERIFY_BLOCK;
+        for(int i = 0; i < n; i++)
+            in[i] = scenario->source ? ((double)((done + i) % nsource) / nsource * 2 - 1) * VERIFY_LEVEL : 0;
+        for(int v = 0; v < nvoices; v++)
+            control_scenario(scenario, tracts[v], done, frames);
+
+        sample_t *o = out + done;
+        switch(variant->engine) {
+            case ENGINE_REFERENCE:
+                for(int i = 0; i < n; i++)
+                    o[i] = run_reference(tracts[0], in[i]);
+                break;
+            case ENGINE_SAMPLE:
+                for(int i = 0; i < n; i++)
+                    o[i] = run_tract(tracts[0], in[i]);
+                break;
+            case ENGINE_BLOCK:
+                run_tract_block(tracts[0], in, o, n);
+                break;
+            case ENGINE_CHOIR:
+                // every voice sings the same so the average is what one of them sang
+                run_choir(&verify_choir, in, o, n);
+                for(int i = 0; i < n; i++)
+                    o[i] /= nvoices;
+                break;
+        }
+    }
+
+    if(variant->engine == ENGINE_CHOIR)
+        free_choir(&verify_choir);
+    else
+        free_tract(&verify_tract);
+    scatter_kernel = kernel;
+    fixed_kernels = 1;
+}
+
+// in place radix 2 fft, n a power of 2
+static void fft(double *re, double *im, int n) {
+    for(int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if(i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for(int len = 2; len <= n; len <<= 1) {
+        double angle = -2 * M_PI / len;
+        for(int i = 0; i < n; i += len) {
+            for(int k = 0; k < len / 2; k++) {
+                double wr = cos(angle * k), wi = sin(angle * k);
+                double *ar = &re[i + k], *ai = &im[i + k];
+                double *br = &re[i + k + len / 2], *bi = &im[i + k + len / 2];
+                double tr = *br * wr - *bi * wi;
+                double ti = *br * wi + *bi * wr;
+                *br = *ar - tr;
+                *bi = *ai - ti;
+                *ar += tr;
+                *ai += ti;
+            }
+        }
+    }
+}
+
+// average power spectrum over half overlapping hann windowed frames
+static void power_spectrum(const sample_t *x, long frames, double *power) {
+    int n = VERIFY_FFT;
+    double re[VERIFY_FFT], im[VERIFY_FFT];
+    memset(power, 0, sizeof(double) * (n / 2 + 1));
+    for(long start = 0; start + n <= frames; start += n / 2) {
+        for(int i = 0; i < n; i++) {
+            re[i] = x[start + i] * (0.5 - 0.5 * cos(2 * M_PI * i / n));
+            im[i] = 0;
+        }
+        fft(re, im, n);
+        for(int k = 0; k <= n / 2; k++)
+            power[k] += re[k] * re[k] + im[k] * im[k];
+    }
+}
+
+// rms db difference over the bins of the reference within VERIFY_FLOOR of its loudest
+static double spectral_error(const sample_t *reference, const sample_t *x, long frames) {
+    double pr[VERIFY_FFT / 2 + 1], px[VERIFY_FFT / 2 + 1];
+    power_spectrum(reference, frames, pr);
+    power_spectrum(x, frames, px);
+    double loudest = 0;
+    for(int k = 1; k <= VERIFY_FFT / 2; k++)
+        if(pr[k] > loudest)
+            loudest = pr[k];
+    if(loudest == 0)
+        return 0;
+    double floor = loudest * pow(10, -VERIFY_FLOOR / 10.0);
+    double sum = 0;
+    int count = 0;
+    for(int k = 1; k <= VERIFY_FFT / 2; k++) {
+        if(pr[k] < floor)
+            continue;
+        double db = 10 * log10((px[k] + floor * 1e-6) / pr[k]);
+        sum += db * db;
+        count++;
+    }
+    return count ? sqrt(sum / count) : 0;
+}
+
+// biggest difference over the peak of the reference
+static double max_error(const sample_t *reference, const sample_t *x, long frames) {
+    double peak = 0, error = 0;
+    for(long i = 0; i < frames; i++) {
+        if(fabs(reference[i]) > peak)
+            peak = fabs(reference[i]);
+        if(fabs(x[i] - reference[i]) > error)
+            error = fabs(x[i] - reference[i]);
+    }
+    return peak > 0 ? error / peak : error;
+}
+
+int verify_engines(FILE *out) {
+    // the scenarios: a click, every phoneme, a length sweep, pressure changes, frication and the nose
+    struct Scenario scenarios[MAX_PHONEMES + 6];
+    int nscenarios = 0;
+    memset(scenarios, 0, sizeof(scenarios));
+    // the lips are shut so next to nothing gets out, and float coefficients only just resolve how much
+    strcpy(scenarios[nscenarios].name, "impulse");
+    scenarios[nscenarios].impulse = 1;
+    scenarios[nscenarios].waveform = 1;
+    scenarios[nscenarios].max_allowance = 0.02;
+    scenarios[nscenarios++].spectral_allowance = 2.5;
+    init_phonemes();
+    for(int p = 0; p < phoneme_map.nphonemes; p++) {
+        snprintf(scenarios[nscenarios].name, sizeof(scenarios[nscenarios].name), "phoneme%i", p);
+        scenarios[nscenarios].source = 1;
+        scenarios[nscenarios].waveform = 1;
+        scenarios[nscenarios++].phoneme = &phoneme_map.phonemes[p];
+    }
+    // the block path ramps the lips allpasses to every new length instead of jumping
+    // so the phase wanders off a bit (on purpose)
+    strcpy(scenarios[nscenarios].name, "sweep");
+    scenarios[nscenarios].source = 1;
+    scenarios[nscenarios].phoneme = &PHONEME_A;
+    scenarios[nscenarios++].sweep = 1;
+    strcpy(scenarios[nscenarios].name, "pressure");
+    scenarios[nscenarios].phoneme = &PHONEME_O;
+    scenarios[nscenarios].waveform = 1;
+    scenarios[nscenarios++].pressure = 1;
+    // every path draws the same noise in the same order, so the noise has to come out the same too
+    strcpy(scenarios[nscenarios].name, "frication");
+    scenarios[nscenarios].source = 1;
+    scenarios[nscenarios].phoneme = &PHONEME_I;
+    scenarios[nscenarios].frication = 1;
+    scenarios[nscenarios].waveform = 1;
+    scenarios[nscenarios++].pressure = 1;
+    strcpy(scenarios[nscenarios].name, "velum");
+    scenarios[nscenarios].source = 1;
+    scenarios[nscenarios].phoneme = &PHONEME_A;
+    scenarios[nscenarios].waveform = 1;
+    scenarios[nscenarios++].velum = 1;
+    // the block path carries on from the coefficients it had when the velum moves instead of jumping
+    // so like the sweep its the same sound but not quite the same waveform
+    strcpy(scenarios[nscenarios].name, "velum_moving");
+    scenarios[nscenarios].source = 1;
+    scenarios[nscenarios].phoneme = &PHONEME_A;
+    scenarios[nscenarios++].velum = 2;
+
+    // the engines and how far from the reference each is allowed to be
+    // run_tract() is the reference with floats in a couple of places
+    // the block paths ramp the shape over every control period, the longer the further off
+    // and all the kernels, gangs and threads do exactly the same sums as the scalar block path
+    struct Variant variants[nscatter_kernels + 7];
+    memset(variants, 0, sizeof(variants));
+    int nvariants = 0;
+    strcpy(variants[nvariants].name, "sample");
+    variants[nvariants].engine = ENGINE_SAMPLE;
+    variants[nvariants].max_error = 1e-6;
+    variants[nvariants++].spectral_error = 0.001;
+    const struct ScatterKernel *fastest = NULL;
+    for(int i = 0; i < nscatter_kernels; i++) {
+        if(!scatter_kernels[i].supported())
+            continue;
+        if(fastest == NULL)
+            fastest = &scatter_kernels[i];
+        snprintf(variants[nvariants].name, sizeof(variants[nvariants].name), "block/%s", scatter_kernels[i].name);
+        variants[nvariants].engine = ENGINE_BLOCK;
+        variants[nvariants].kernel = &scatter_kernels[i];
+        variants[nvariants].max_error = 0.03;
+        variants[nvariants++].spectral_error = 0.15;
+    }
+    // the fixed length kernels are the same sums again, so without them has to be the same too
+    strcpy(variants[nvariants].name, "block/generic");
+    variants[nvariants].engine = ENGINE_BLOCK;
+    variants[nvariants].kernel = fastest;
+    variants[nvariants].generic = 1;
+    variants[nvariants].max_error = 0.03;
+    variants[nvariants++].spectral_error = 0.15;
+    for(int period = MIN_CONTROL_PERIOD; period <= MAX_CONTROL_PERIOD; period *= 2) {
+        if(period == CONTROL_PERIOD)
+            continue;
+        snprintf(variants[nvariants].name, sizeof(variants[nvariants].name), "block/p%i", period);
+        variants[nvariants].engine = ENGINE_BLOCK;
+        variants[nvariants].kernel = fastest;
+        variants[nvariants].period = period;
+        variants[nvariants].max_error = 0.03 * period / CONTROL_PERIOD;
+        variants[nvariants++].spectral_error = 0.15 * period / CONTROL_PERIOD;
+    }
+    snprintf(variants[nvariants].name, sizeof(variants[nvariants].name), "choir/gang");
+    variants[nvariants].engine = ENGINE_CHOIR;
+    variants[nvariants].kernel = fastest;
+    variants[nvariants].nvoices = GANG_LANES;
+    variants[nvariants].max_error = 0.03;
+    variants[nvariants++].spectral_error = 0.15;
+    snprintf(variants[nvariants].name, sizeof(variants[nvariants].name), "choir/threads");
+    variants[nvariants].engine = ENGINE_CHOIR;
+    variants[nvariants].kernel = fastest;
+    variants[nvariants].nvoices = GANG_LANES * 2;
+    variants[nvariants].nthreads = 2;
+    variants[nvariants].max_error = 0.03;
+    variants[nvariants++].spectral_error = 0.15;
+
+    long frames = VERIFY_SECONDS * VERIFY_RATE;
+    sample_t *reference = malloc(sizeof(sample_t) * frames);
+    sample_t *x = malloc(sizeof(sample_t) * frames);
+    if(reference == NULL || x == NULL) {
+        fprintf(stderr, "could not allocate verification buffers\n");
+        exit(1);
+    }
+    struct Variant frozen = { "reference", ENGINE_REFERENCE };
+
+    int failures = 0;
+    fprintf(out, "scenario,engine,max_error,max_allowed,spectral_error_db,spectral_allowed_db,ok\n");
+    for(int s = 0; s < nscenarios; s++) {
+        const struct Scenario *scenario = &scenarios[s];
+        render_variant(&frozen, scenario, reference, frames);
+        for(int v = 0; v < nvariants; v++) {
+            const struct Variant *variant = &variants[v];
+            if(scenario->velum && variant->engine == ENGINE_SAMPLE)
+                continue;
+            render_variant(variant, scenario, x, frames);
+            double error = max_error(reference, x, frames);
+            double spectral = spectral_error(reference, x, frames);
+            double max_allowed = variant->max_error + scenario->max_allowance;
+            double spectral_allowed = variant->spectral_error + scenario->spectral_allowance;
+            int ok = spectral <= spectral_allowed && (!scenario->waveform || error <= max_allowed);
+            if(scenario->waveform)
+                fprintf(out, "%s,%s,%.3g,%.3g,%.3f,%.3f,%s\n", scenario->name, variant->name,
+                        error, max_allowed, spectral, spectral_allowed, ok ? "ok" : "FAIL");
+            else
+                fprintf(out, "%s,%s,%.3g,-,%.3f,%.3f,%s\n", scenario->name, variant->name,
+                        error, spectral, spectral_allowed, ok ? "ok" : "FAIL");
+            fflush(out);
+            failures += !ok;
+        }
+    }
+
+    free(reference);
+    free(x);
+    return failures;
+}
+
+// the made up machine: how much each level costs next to full quality
+// (every voice singing, like the real thing roughly) and how slow it is over time
+// first so slow it xruns, then just too slow for full quality, then plenty fast
+static const double governor_cost[NQUALITY] = { 1.0, 0.8, 0.8, 0.3, 0.17, 0.1 };
+#define GOVERNOR_SLOW 4.0
+#define GOVERNOR_BIT_SLOW 1.2
+#define GOVERNOR_FAST 0.3
+#define GOVERNOR_SECONDS 130
+
+static double governor_load(double t) {
+    return t < 20 ? GOVERNOR_SLOW : t < 100 ? GOVERNOR_BIT_SLOW : GOVERNOR_FAST;
+}
+
+// when the machine last changed speed
+static double governor_phase(double t) {
+    return t < 20 ? 0 : t < 100 ? 20 : 100;
+}
+
+// which side of the thresholds a load is
+static int governor_side(double load) {
+    return load > GOVERN_HIGH ? 1 : load < GOVERN_LOW ? -1 : 0;
+}
+
+// what it should do: drop straight through to the level that doesnt xrun a settle at a time
+// (skipping quartered updates, the default period halved is already as long as they go)
+// then once the machine is only a bit slow keep trying full updates again and going back
+// down, waiting twice as long every time up to GOVERN_BACKOFF, and once its fast get all the way back
+struct GovernorChange {
+    int level;
+    int backoff;
+};
+
+static const struct GovernorChange governor_changes[] = {
+    { QUALITY_PERIOD, 1 }, { QUALITY_NOISE, 1 }, { QUALITY_VOICES, 1 },
+    { QUALITY_NOISE, 1 }, { QUALITY_PERIOD, 1 },
+    { QUALITY_NOISE, 2 }, { QUALITY_PERIOD, 2 },
+    { QUALITY_NOISE, 4 }, { QUALITY_PERIOD, 4 },
+    { QUALITY_NOISE, 8 }, { QUALITY_PERIOD, 8 },
+    { QUALITY_NOISE, 8 }, { QUALITY_PERIOD, 8 },
+    { QUALITY_NOISE, 8 }, { QUALITY_PERIOD, 8 },
+    { QUALITY_FULL, 8 },
+};
+#define NGOVERNOR_CHANGES (int)(sizeof(governor_changes) / sizeof(governor_changes[0]))
+
+// how long it should have waited for a change (seconds)
+// since the last one or since the machine changing speed moved the load past a threshold, whichever was later
+// (the load gets smoothed so everything takes a little longer than the holds)
+#define GOVERNOR_LAG 0.2
+static double governor_wait(const struct Governor *governor, int from, int level, double load) {
+    if(level > from)
+        return load >= 1 ? GOVERN_SETTLE : GOVERN_HOLD_DOWN;
+    return GOVERN_HOLD_UP * (governor->failed == level ? governor->backoff : 1);
+}
+
+int verify_governor(FILE *out) {
+    int rate = VERIFY_RATE;
+    struct Choir choir;
+    struct Governor governor;
+    init_quiet_choir(&choir, MAX_VOICES / 2, rate, TRACT_LENGTH);
+    init_governor(&governor, &choir, rate);
+
+    int failures = 0, n = 0;
+    double last = 0;
+    uint64_t period_ns = (uint64_t)VERIFY_BLOCK * 1000000000 / rate;
+    fprintf(out, "change,time_s,level,backoff,expected_level,expected_backoff,waited_s,expected_wait_s,ok\n");
+    for(long frame = 0; frame < (long)GOVERNOR_SECONDS * rate; frame += VERIFY_BLOCK) {
+        double t = (double)(frame + VERIFY_BLOCK) / rate; // by the end of the block
+        int from = governor.level;
+        double load = governor_load(t) * governor_cost[from];
+        // what it has to wait for if it changes now, before the change resets it
+        struct Governor before = governor;
+        govern_choir(&governor, &choir, load * period_ns, period_ns, VERIFY_BLOCK);
+        if(governor.level == from)
+            continue;
+
+        double phase = governor_phase(t);
+        double start = last;
+        if(phase > last && governor_side(governor_load(phase - 1) * governor_cost[from]) != governor_side(load))
+            start = phase;
+        double waited = t - start;
+        double wait = governor_wait(&before, from, governor.level, load);
+        last = t;
+        const struct GovernorChange *expected = n < NGOVERNOR_CHANGES ? &governor_changes[n] : NULL;
+        int ok = expected && governor.level == expected->level && governor.backoff == expected->backoff &&
+                 waited >= wait && waited <= wait + GOVERNOR_LAG;
+        if(expected)
+            fprintf(out, "%i,%.2f,%i,%i,%i,%i,%.2f,%.2f,%s\n", n, t, governor.level, governor.backoff,
+                    expected->level, expected->backoff, waited, wait, ok ? "ok" : "FAIL");
+        else
+            fprintf(out, "%i,%.2f,%i,%i,-,-,%.2f,-,FAIL\n", n, t, governor.level, governor.backoff, waited);
+        failures += !ok;
+        n++;
+    }
+    // and it should have got all the way back
+    for(; n < NGOVERNOR_CHANGES; n++) {
+        fprintf(out, "%i,-,-,-,%i,%i,-,-,FAIL\n", n, governor_changes[n].level, governor_changes[n].backoff);
+        failures++;
+    }
+
+    free_choir(&choir);
+    return failures;
+}
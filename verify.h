@@ -0,0 +1,37 @@
+/*
+ * engine verification
+ *
+ * renders the same fixed scenarios through the frozen reference (reference.c)
+ * and every faster way of running the tract, and checks they still sound the same
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdio.h>
+
+// how much of every scenario to render (seconds)
+#define VERIFY_SECONDS 0.5
+
+// and at what rate
+#define VERIFY_RATE 48000
+
+// frames per call, like a jack period (the controls change between calls)
+#define VERIFY_BLOCK 256
+
+// the spectra are averaged over frames this long (a power of 2)
+#define VERIFY_FFT 1024
+
+// bins more than this far below the loudest one dont count toward the spectral error (db)
+#define VERIFY_FLOOR 60
+
+// print a line of csv for every scenario and engine to out
+// returns how many were further from the reference than theyre allowed
+int verify_engines(FILE *out);
+
+// run the quality governor against a made up machine that gets faster and slower
+// and print a line of csv for every change it makes to out
+// returns how many werent the change it should have made when it should have
+int verify_governor(FILE *out);
+
+#endif
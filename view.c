@@ -0,0 +1,86 @@
+/*
+ * tract views
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "view.h"
+
+void init_view_channel(struct ViewChannel *channel) {
+    memset(channel, 0, sizeof(struct ViewChannel));
+    channel->magic = VIEW_MAGIC;
+}
+
+struct ViewChannel *share_view_channel(const char *name, int create) {
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+    if(fd < 0)
+        return NULL;
+    if(create && ftruncate(fd, sizeof(struct ViewChannel))) {
+        close(fd);
+        return NULL;
+    }
+    struct ViewChannel *channel = mmap(NULL, sizeof(struct ViewChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(channel == MAP_FAILED)
+        return NULL;
+
+    if(create)
+        init_view_channel(channel);
+    else if(channel->magic != VIEW_MAGIC) {
+        munmap(channel, sizeof(struct ViewChannel));
+        return NULL;
+    }
+    return channel;
+}
+
+void unshare_view_channel(struct ViewChannel *channel, const char *name, int unlink) {
+    munmap(channel, sizeof(struct ViewChannel));
+    if(unlink)
+        shm_unlink(name);
+}
+
+void publish_tract_view(struct ViewChannel *channel, const struct Tract *tract, uint64_t frame, int rate) {
+    // odd until its all there
+    unsigned sequence = atomic_load_explicit(&channel->sequence, memory_order_relaxed);
+    atomic_store_explicit(&channel->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    struct TractView *view = &channel->view;
+    int n = tract->nsegments < VIEW_SEGMENTS ? tract->nsegments : VIEW_SEGMENTS;
+    view->frame = frame;
+    view->rate = rate;
+    view->tract_rate = tract->rate;
+    view->nsegments = n;
+    view->tract_length = tract->tract_length;
+    view->velum = tract->velum;
+    view->phoneme = *tract->target_phoneme;
+    for(int i = 0; i < n; i++) {
+        sample_t l = tract->left_front[i];
+        sample_t r = tract->right_front[i];
+        view->area[i] = 1 / tract->segments_front[i].z;
+        view->energy[i] = l * l + r * r;
+    }
+
+    atomic_store_explicit(&channel->sequence, sequence + 2, memory_order_release);
+}
+
+int read_view(struct ViewChannel *channel, struct TractView *view) {
+    for(;;) {
+        unsigned before = atomic_load_explicit(&channel->sequence, memory_order_acquire);
+        if(before == 0)
+            return -1;
+        // halfway through being written, itll be done in a moment
+        if(before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(view, &channel->view, sizeof(struct TractView));
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&channel->sequence, memory_order_relaxed) == before)
+            return 0;
+    }
+}
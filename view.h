@@ -0,0 +1,68 @@
+/*
+ * tract views
+ *
+ * a picture of what the tract is doing for anything that wants to draw it
+ * (a visualizer, something exporting it over a socket), without touching the audio thread
+ *
+ * the audio thread writes a view every so often straight into a channel guarded
+ * by a sequence number (a seqlock): its odd while its being written, so readers
+ * copy the view out and try again if the number moved while they were at it
+ * the writer never waits for anyone and theres no limit on how many readers there are
+ */
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "tract.h"
+
+// more segments than the longest tract at 192khz
+#define VIEW_SEGMENTS 256
+
+// how many views a second the audio thread writes
+#define VIEW_RATE 60
+
+// magic number at the start of a shared channel so nobody maps the wrong thing
+// (a new one whenever TractView changes)
+#define VIEW_MAGIC 0x6e616e77
+
+struct TractView {
+    uint64_t frame; // when it was, on the clock control events count in
+    int rate; // what that clock counts at (the hosts sample rate)
+    int tract_rate; // the tracts own, how far apart the segments are (not the same under -R)
+    int nsegments;
+    double tract_length; // cm
+    double velum;
+    struct Phoneme phoneme; // the shape its heading for
+    float area[VIEW_SEGMENTS]; // cross section of every segment (1 / impedence)
+    float energy[VIEW_SEGMENTS]; // how much wave is in every segment, both ways added up
+};
+
+struct ViewChannel {
+    uint32_t magic;
+    atomic_uint sequence; // odd while a view is being written, 0 = nothing yet
+    struct TractView view;
+};
+
+void init_view_channel(struct ViewChannel *channel);
+
+// put a channel in shared memory under name (like "/nancealoid-view") for other processes
+// the tract side creates it, readers open it with create = 0
+// returns NULL if it couldnt
+struct ViewChannel *share_view_channel(const char *name, int create);
+
+// unmap a shared channel (and remove the name too if unlink)
+void unshare_view_channel(struct ViewChannel *channel, const char *name, int unlink);
+
+// write a view of the tract as it is now, frame from a clock going at rate
+// (only the audio thread, theres one writer)
+// never blocks or allocates, its one pass over the segments
+void publish_tract_view(struct ViewChannel *channel, const struct Tract *tract, uint64_t frame, int rate);
+
+// copy out the latest view (any thread, any number of them)
+// returns 0 on success, -1 if nothing has been written yet
+int read_view(struct ViewChannel *channel, struct TractView *view);
+
+#endif
@@ -0,0 +1,541 @@
+/*
+ * voices
+ *
+ * plain voice allocation: a note gets a free voice if there is one,
+ * otherwise it steals the oldest one (preferring voices already ringing out)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "voice.h"
+#include "rtlog.h"
+
+// make room for n more threads to run voices
+void add_workspaces(struct Choir *choir, int n) {
+    struct Workspace *workspaces = realloc(choir->workspaces, sizeof(struct Workspace) * (choir->nworkspaces + n));
+    if(workspaces == NULL) {
+        fprintf(stderr, "could not allocate voice workspaces\n");
+        exit(1);
+    }
+    choir->workspaces = workspaces;
+
+    // room for the longest the voices can get
+    for(int i = 0; i < n; i++)
+        init_gang(&choir->workspaces[choir->nworkspaces++].gang, choir->voices[0].tract.capacity);
+}
+
+// where a voice starting on this phoneme can be copied from, NULL if its not one in the map
+static struct TractSnapshot *warm_snapshot(struct Choir *choir, const struct Phoneme *phoneme) {
+    for(int p = 0; p < choir->nwarm; p++)
+        if(same_phoneme(&phoneme_map.phonemes[p], phoneme))
+            return &choir->warm[p];
+    return NULL;
+}
+
+// 1 if a warm snapshot is the shape a tract would be in (the same segments and velum)
+// the extra length is just the lips allpass so warm_voice() takes that from the tract
+// (otherwise every little wobble of a length controller would make them all stale)
+static int warm_fits(const struct TractSnapshot *warm, const struct Tract *tract) {
+    return warm->saved && warm->state.nsegments == tract->nsegments && warm->state.velum == tract->velum;
+}
+
+// silent and settled into the shape of the phoneme its on, ready for a note
+static void settle_voice(struct Tract *tract) {
+    clear_tract(tract);
+    snap_shape(tract);
+    tract->lips_allpass = tract->lips_allpass_target;
+}
+
+void prewarm_choir(struct Choir *choir) {
+    struct Tract *tract = &choir->voices[0].tract;
+    struct TractSnapshot spare;
+    if(init_snapshot(&spare, tract)) {
+        fprintf(stderr, "could not allocate voices\n");
+        exit(1);
+    }
+    save_tract(tract, &spare);
+    for(int p = 0; p < choir->nwarm; p++) {
+        tract->ambient_phoneme = phoneme_map.phonemes[p];
+        settle_voice(tract);
+        save_tract(tract, &choir->warm[p]);
+    }
+    restore_tract(tract, &spare);
+    free_snapshot(&spare);
+}
+
+// start a voice from silence already in the shape of the phoneme everyone is singing
+// so a note doesnt crossfade in from wherever the voice was left (or carry a stolen note over)
+// a copy of the warm snapshot of that phoneme if theres one that fits,
+// otherwise the shape is worked out and kept in the snapshot for next time
+static void warm_voice(struct Choir *choir, struct Voice *voice) {
+    struct Tract *tract = &voice->tract;
+    struct TractSnapshot *warm = warm_snapshot(choir, &tract->ambient_phoneme);
+    if(warm && warm_fits(warm, tract)) {
+        // just the shape, the voice keeps its own noise and whatever the controllers set
+        struct Tract mine = *tract;
+        restore_tract(tract, warm);
+        tract->interpolation_drag = mine.interpolation_drag;
+        tract->diaphram_pressure = mine.diaphram_pressure;
+        tract->damping = mine.damping;
+        tract->frication = mine.frication;
+        tract->interpolation = mine.interpolation;
+        tract->control_period = mine.control_period;
+        tract->noise = mine.noise;
+        // and the length its at now, already settled like everything else
+        tract->extra_length = mine.extra_length;
+        tract->tract_length = mine.tract_length;
+        tract->lips_allpass_target = mine.lips_allpass_target;
+        tract->lips_allpass = mine.lips_allpass_target;
+    } else {
+        settle_voice(tract);
+        if(warm)
+            save_tract(tract, warm);
+    }
+    tract->asleep = 0;
+}
+
+static void build_choir(struct Choir *choir, int nvoices, int sample_rate, double length, int quiet) {
+    if(nvoices < 1) nvoices = 1;
+    if(nvoices > MAX_VOICES) nvoices = MAX_VOICES;
+    choir->nvoices = nvoices;
+    choir->limit = nvoices;
+    choir->voices = calloc(nvoices, sizeof(struct Voice));
+    if(choir->voices == NULL) {
+        fprintf(stderr, "could not allocate voices\n");
+        exit(1);
+    }
+    choir->release_frames = VOICE_RELEASE * sample_rate;
+    choir->clock = 0;
+
+    choir->interleave = 1;
+    choir->threaded = 0;
+    choir->glottis = 0;
+
+    for(int i = 0; i < nvoices; i++) {
+        struct Voice *voice = &choir->voices[i];
+        // only the first voice says whats going on, theyre all the same anyway
+        voice->tract.quiet = quiet || i > 0;
+        setup_tract(&voice->tract, sample_rate);
+        if(length != TRACT_LENGTH)
+            resize_tract(&voice->tract, length);
+        seed_tract(&voice->tract, DEFAULT_NOISE_SEED + i);
+        // a lone voice just sings all the time like it always did
+        voice->active = voice->held = nvoices == 1;
+        voice->gain = 1;
+    }
+
+    choir->nworkspaces = 0;
+    choir->workspaces = NULL;
+    add_workspaces(choir, 1);
+
+    choir->resampling = 0;
+
+    // a warm start for every phoneme in the map
+    choir->nwarm = phoneme_map.nphonemes;
+    choir->warm = calloc(choir->nwarm, sizeof(struct TractSnapshot));
+    for(int p = 0; p < choir->nwarm; p++)
+        if(init_snapshot(&choir->warm[p], &choir->voices[0].tract)) {
+            fprintf(stderr, "could not allocate voices\n");
+            exit(1);
+        }
+    prewarm_choir(choir);
+
+    if(nvoices > 1 && !quiet)
+        printf("voices = %i\n", nvoices);
+}
+
+int start_choir_threads(struct Choir *choir, int nthreads, int priority) {
+    if(nthreads < 1 || choir->nvoices < THREADED_MIN_VOICES)
+        return 0;
+    add_workspaces(choir, nthreads);
+    if(start_pool(&choir->pool, nthreads, priority))
+        return -1;
+    printf("voice threads = %i\n", choir->pool.nthreads + 1);
+    if(choir->pool.nthreads == 0) {
+        // only the one cpu
+        stop_pool(&choir->pool);
+        return 0;
+    }
+    choir->threaded = 1;
+    return 0;
+}
+
+void free_choir(struct Choir *choir) {
+    if(choir->threaded)
+        stop_pool(&choir->pool);
+    choir->threaded = 0;
+    for(int i = 0; i < choir->nvoices; i++)
+        free_tract(&choir->voices[i].tract);
+    free(choir->voices);
+    for(int p = 0; p < choir->nwarm; p++)
+        free_snapshot(&choir->warm[p]);
+    free(choir->warm);
+    choir->warm = NULL;
+    choir->nwarm = 0;
+    for(int i = 0; i < choir->nworkspaces; i++)
+        free_gang(&choir->workspaces[i].gang);
+    free(choir->workspaces);
+    choir->workspaces = NULL;
+    choir->nworkspaces = 0;
+    if(choir->resampling) {
+        free_resampler(&choir->to_inside);
+        free_resampler(&choir->to_outside);
+        free(choir->inside_in);
+        free(choir->inside_out);
+        free(choir->pending);
+    }
+    choir->resampling = 0;
+    choir->voices = NULL;
+    choir->nvoices = 0;
+}
+
+void init_choir(struct Choir *choir, int nvoices, int sample_rate, double length) {
+    build_choir(choir, nvoices, sample_rate, length, 0);
+}
+
+void init_quiet_choir(struct Choir *choir, int nvoices, int sample_rate, double length) {
+    build_choir(choir, nvoices, sample_rate, length, 1);
+}
+
+void snap_choir(struct Choir *choir) {
+    for(int i = 0; i < choir->nvoices; i++)
+        snap_shape(&choir->voices[i].tract);
+}
+
+void seed_choir(struct Choir *choir, uint32_t seed) {
+    for(int i = 0; i < choir->nvoices; i++)
+        seed_tract(&choir->voices[i].tract, seed + i);
+}
+
+void set_choir_control_period(struct Choir *choir, int period) {
+    for(int i = 0; i < choir->nvoices; i++)
+        set_control_period(&choir->voices[i].tract, period);
+}
+
+void time_choir(struct Choir *choir, int on) {
+    for(int i = 0; i < choir->nvoices; i++)
+        time_tract(&choir->voices[i].tract, on);
+}
+
+uint64_t take_choir_shape_ns(struct Choir *choir) {
+    uint64_t ns = 0;
+    for(int i = 0; i < choir->nvoices; i++) {
+        ns += choir->voices[i].tract.shape_ns;
+        choir->voices[i].tract.shape_ns = 0;
+    }
+    return ns;
+}
+
+void use_glottis(struct Choir *choir) {
+    init_glottis();
+    choir->glottis = 1;
+    // theres no pitch to sing until a note comes along
+    for(int i = 0; i < choir->nvoices; i++)
+        choir->voices[i].active = choir->voices[i].held = 0;
+}
+
+// find a voice for a new note
+struct Voice *allocate_voice(struct Choir *choir) {
+    struct Voice *oldest = NULL;
+    struct Voice *oldest_released = NULL;
+    for(int i = 0; i < choir->limit; i++) {
+        struct Voice *voice = &choir->voices[i];
+        if(!voice->active)
+            return voice;
+        if(!voice->held && (oldest_released == NULL || voice->age < oldest_released->age))
+            oldest_released = voice;
+        if(oldest == NULL || voice->age < oldest->age)
+            oldest = voice;
+    }
+    return oldest_released ? oldest_released : oldest;
+}
+
+void note_on(struct Choir *choir, uint8_t channel, uint8_t note, uint8_t velocity) {
+    struct Voice *voice = allocate_voice(choir);
+    warm_voice(choir, voice);
+    voice->active = 1;
+    voice->held = 1;
+    voice->channel = channel;
+    voice->note = note;
+    voice->gain = velocity / 127.0;
+    voice->age = choir->clock++;
+    if(choir->glottis)
+        start_glottis(&voice->glottis, note_frequency(note), voice->tract.rate);
+    if(!choir->voices[0].tract.quiet)
+        rt_log(LOG_EVENTS, "  [chan %02d] voice %i note ON:  0x%x, 0x%x\n", channel, (int)(voice - choir->voices), note, velocity);
+}
+
+void note_off(struct Choir *choir, uint8_t channel, uint8_t note) {
+    for(int i = 0; i < choir->nvoices; i++) {
+        struct Voice *voice = &choir->voices[i];
+        if(voice->held && voice->channel == channel && voice->note == note) {
+            voice->held = 0;
+            voice->release = choir->release_frames;
+        }
+    }
+}
+
+void limit_choir(struct Choir *choir, int nvoices) {
+    if(nvoices < 1) nvoices = 1;
+    if(nvoices > choir->nvoices) nvoices = choir->nvoices;
+    choir->limit = nvoices;
+    for(int i = nvoices; i < choir->nvoices; i++) {
+        struct Voice *voice = &choir->voices[i];
+        if(voice->held) {
+            voice->held = 0;
+            voice->release = choir->release_frames;
+        }
+    }
+}
+
+void choir_midi(struct Choir *choir, const uint8_t *buffer, size_t size) {
+    if(size < 3)
+        return;
+
+    uint8_t type = buffer[0] & 0xf0;
+    uint8_t chan = buffer[0] & 0x0f;
+
+    // notes on the other channels only mean anything when theres voices to play them
+    // (or a pitch to play them at)
+    if((choir->nvoices > 1 || choir->glottis) && chan != PHONEME_CHANNEL) {
+        if(type == 0x90 && buffer[2] > 0) {
+            note_on(choir, chan, buffer[1], buffer[2]);
+            return;
+        }
+        if(type == 0x80 || type == 0x90) {
+            note_off(choir, chan, buffer[1]);
+            return;
+        }
+    }
+
+    // everything else shapes every voice the same
+    for(int i = 0; i < choir->nvoices; i++)
+        handle_midi(&choir->voices[i].tract, buffer, size);
+}
+
+void choir_control(struct Choir *choir, const struct ControlEvent *event) {
+    for(int i = 0; i < choir->nvoices; i++)
+        control_tract(&choir->voices[i].tract, event);
+}
+
+// what a voice hears of the source
+static inline sample_t voice_gain(const struct Voice *voice) {
+    // let go voices get no more source and just ring out
+    return voice->held ? voice->gain : 0;
+}
+
+// the source as a voice hears it, every stride samples of out
+// the glottal source goes on top of the one coming in
+void voice_source(struct Workspace *work, struct Voice *voice, int glottis, const sample_t *in, sample_t *out, int stride, int n) {
+    sample_t gain = voice_gain(voice);
+    if(glottis && voice->held) {
+        memcpy(work->in, in, sizeof(sample_t) * n);
+        run_glottis(&voice->glottis, work->in, n);
+        in = work->in;
+    }
+    for(int i = 0; i < n; i++)
+        out[i * stride] = in[i] * gain;
+}
+
+// 1 if a voices source is going to be all zeros this block
+// (released voices get no source, and the glottis never stops while a note is held)
+static inline int source_silent(const struct Choir *choir, const struct Voice *voice, int in_silent) {
+    return voice_gain(voice) == 0 || (in_silent && !(choir->glottis && voice->held));
+}
+
+// run a voice by itself
+void run_voice(struct Workspace *work, struct Voice *voice, int glottis, const sample_t *in, int n) {
+    voice_source(work, voice, glottis, in, work->in, 1, n);
+    run_tract_block(&voice->tract, work->in, voice->out, n);
+    settle_tract(&voice->tract, voice->silent);
+}
+
+// run a bunch of voices the same length side by side
+void run_voices_ganged(struct Workspace *work, struct Voice **voices, int nlanes, int glottis, const sample_t *in, int n) {
+    struct Tract *tracts[GANG_LANES];
+    for(int v = 0; v < nlanes; v++) {
+        tracts[v] = &voices[v]->tract;
+        voice_source(work, voices[v], glottis, in, work->gang_in + v, GANG_LANES, n);
+    }
+
+    load_gang(&work->gang, tracts, nlanes);
+    run_gang(&work->gang, work->gang_in, work->gang_out, n);
+    store_gang(&work->gang);
+
+    for(int v = 0; v < nlanes; v++) {
+        for(int i = 0; i < n; i++)
+            voices[v]->out[i] = work->gang_out[i * GANG_LANES + v];
+        settle_tract(&voices[v]->tract, voices[v]->silent);
+    }
+}
+
+// run one of the jobs for the current block
+// (a pool_job, worker picks the workspace)
+void run_job(void *arg, int index, int worker) {
+    struct Choir *choir = arg;
+    struct Job *job = &choir->jobs[index];
+    struct Workspace *work = &choir->workspaces[worker];
+    flush_denormals();
+    // a gang of 1 is just a slower way of running it alone
+    if(job->nvoices > 1)
+        run_voices_ganged(work, job->voices, job->nvoices, choir->glottis, choir->job_in, choir->job_frames);
+    else
+        run_voice(work, job->voices[0], choir->glottis, choir->job_in, choir->job_frames);
+}
+
+// sort the sounding voices into jobs
+// one job for every gang of voices that can run side by side
+// voices that are asleep and getting no source dont need running at all
+void plan_jobs(struct Choir *choir, int in_silent, int n) {
+    for(int v = 0; v < choir->nvoices; v++) {
+        struct Voice *voice = &choir->voices[v];
+        voice->ganged = 0;
+        if(!voice->active)
+            continue;
+        voice->silent = source_silent(choir, voice, in_silent);
+        if(skip_tract(&voice->tract, voice->silent, n)) {
+            memset(voice->out, 0, sizeof(sample_t) * n);
+            voice->ganged = 1;
+        }
+    }
+
+    choir->njobs = 0;
+    int capacity = choir->workspaces[0].gang.capacity;
+    for(int v = 0; v < choir->nvoices; v++) {
+        struct Voice *voice = &choir->voices[v];
+        if(!voice->active || voice->ganged)
+            continue;
+
+        struct Job *job = &choir->jobs[choir->njobs++];
+        job->nvoices = 0;
+        if(choir->interleave && voice->tract.nsegments <= capacity && !voice->tract.nose_open) {
+            // round up everyone who can run alongside this one
+            for(int u = v; u < choir->nvoices && job->nvoices < GANG_LANES; u++) {
+                struct Voice *other = &choir->voices[u];
+                if(other->active && !other->ganged && same_gang(&voice->tract, &other->tract)) {
+                    other->ganged = 1;
+                    job->voices[job->nvoices++] = other;
+                }
+            }
+        } else {
+            voice->ganged = 1;
+            job->voices[job->nvoices++] = voice;
+        }
+    }
+}
+
+// run every sounding voice for n <= CHOIR_BLOCK samples
+void run_voices(struct Choir *choir, const sample_t *in, int n) {
+    plan_jobs(choir, silent_block(in, n), n);
+    choir->job_in = in;
+    choir->job_frames = n;
+
+    // every voice writes only its own out buffer so it doesnt matter who runs what
+    if(choir->threaded && choir->njobs > 1) {
+        int nsinging = 0;
+        for(int j = 0; j < choir->njobs; j++)
+            nsinging += choir->jobs[j].nvoices;
+        if(nsinging >= THREADED_MIN_VOICES) {
+            run_pool(&choir->pool, run_job, choir, choir->njobs);
+            return;
+        }
+    }
+    for(int j = 0; j < choir->njobs; j++)
+        run_job(choir, j, 0);
+}
+
+int resample_choir(struct Choir *choir, int outside_rate) {
+    int inside_rate = choir->voices[0].tract.rate;
+    if(outside_rate == inside_rate)
+        return 0;
+    if(init_resampler(&choir->to_inside, outside_rate, inside_rate))
+        return -1;
+    if(init_resampler(&choir->to_outside, inside_rate, outside_rate)) {
+        free_resampler(&choir->to_inside);
+        return -1;
+    }
+
+    int max_inside = resampler_max_out(&choir->to_inside, CHOIR_BLOCK);
+    choir->inside_in = malloc(sizeof(sample_t) * max_inside);
+    choir->inside_out = malloc(sizeof(sample_t) * max_inside);
+
+    // the outside gets a little head start of silence so that theres always
+    // a whole block ready even when the last one came out a sample or two short
+    int head_start = outside_rate / inside_rate + 2;
+    choir->pending = calloc(head_start + CHOIR_BLOCK + resampler_max_out(&choir->to_outside, max_inside), sizeof(sample_t));
+    if(choir->inside_in == NULL || choir->inside_out == NULL || choir->pending == NULL) {
+        fprintf(stderr, "could not allocate resampling buffers\n");
+        exit(1);
+    }
+    choir->npending = head_start;
+    choir->resampling = 1;
+
+    if(!choir->voices[0].tract.quiet)
+        printf("inside rate = %ihz (resampling from %ihz, %i and %i taps)\n",
+               inside_rate, outside_rate, choir->to_inside.taps, choir->to_outside.taps);
+    return 0;
+}
+
+// run the choir at its own rate
+void sing_choir(struct Choir *choir, const sample_t *in, sample_t *out, int nframes) {
+    // the classic way, straight through
+    if(choir->nvoices == 1 && !choir->glottis) {
+        struct Tract *tract = &choir->voices[0].tract;
+        int silent = silent_block(in, nframes);
+        if(skip_tract(tract, silent, nframes)) {
+            memset(out, 0, sizeof(sample_t) * nframes);
+            return;
+        }
+        run_tract_block(tract, in, out, nframes);
+        settle_tract(tract, silent);
+        return;
+    }
+
+    for(int start = 0; start < nframes; start += CHOIR_BLOCK) {
+        int n = nframes - start < CHOIR_BLOCK ? nframes - start : CHOIR_BLOCK;
+        run_voices(choir, in + start, n);
+
+        // only clear it once the voices have their source, in and out can be the same buffer
+        memset(out + start, 0, sizeof(sample_t) * n);
+
+        // mix in voice order so it always adds up the same
+        for(int v = 0; v < choir->nvoices; v++) {
+            struct Voice *voice = &choir->voices[v];
+            if(!voice->active)
+                continue;
+            for(int i = 0; i < n; i++)
+                out[start + i] += voice->out[i];
+
+            if(!voice->held) {
+                voice->release -= n;
+                if(voice->release <= 0) {
+                    voice->active = 0;
+                    clear_tract(&voice->tract);
+                }
+            }
+        }
+    }
+}
+
+void run_choir(struct Choir *choir, const sample_t *in, sample_t *out, int nframes) {
+    flush_denormals();
+    if(!choir->resampling) {
+        sing_choir(choir, in, out, nframes);
+        return;
+    }
+
+    for(int start = 0; start < nframes; start += CHOIR_BLOCK) {
+        int n = nframes - start < CHOIR_BLOCK ? nframes - start : CHOIR_BLOCK;
+        int inside = run_resampler(&choir->to_inside, in + start, n, choir->inside_in);
+        sing_choir(choir, choir->inside_in, choir->inside_out, inside);
+        choir->npending += run_resampler(&choir->to_outside, choir->inside_out, inside, choir->pending + choir->npending);
+
+        // the head start means there should always be enough, but never read past the end
+        int ready = choir->npending < n ? choir->npending : n;
+        memcpy(out + start, choir->pending, sizeof(sample_t) * ready);
+        memset(out + start + ready, 0, sizeof(sample_t) * (n - ready));
+        choir->npending -= ready;
+        memmove(choir->pending, choir->pending + ready, sizeof(sample_t) * choir->npending);
+    }
+}
@@ -0,0 +1,160 @@
+/*
+ * voices
+ *
+ * a choir of independent vocal tracts so more than one note can sound at once
+ * midi notes on any channel but the phoneme channel start and stop voices,
+ * everything else (controllers, phonemes) goes to every voice
+ */
+
+#ifndef VOICE_H
+#define VOICE_H
+
+#include "tract.h"
+#include "gang.h"
+#include "pool.h"
+#include "resample.h"
+#include "glottis.h"
+
+// most voices a choir can have
+#define MAX_VOICES 32
+
+// how long a voice keeps ringing after its note is let go (seconds)
+#define VOICE_RELEASE 0.25
+
+// how many frames the choir mixes at a time
+#define CHOIR_BLOCK 256
+
+// dont bother waking up other threads for fewer voices than this
+#define THREADED_MIN_VOICES 4
+
+// a single tract and the note its singing
+struct Voice {
+    struct Tract tract;
+    int active; // 1 = sounding (held or ringing out)
+    int held; // 1 = the note is still down
+    long release; // samples left to ring out after the note is let go
+    uint8_t channel;
+    uint8_t note;
+    sample_t gain; // from the note velocity
+    struct Glottis glottis; // its own source at the notes pitch (if the choir has them on)
+    unsigned long age; // when the note started, for stealing the oldest one
+    int ganged; // already run this block
+    int silent; // its source is all zeros this block
+    sample_t out[CHOIR_BLOCK]; // what it sang this block before its mixed in
+};
+
+// scratch space for running voices, every thread that runs them has its own
+struct Workspace {
+    sample_t in[CHOIR_BLOCK]; // the source as a voice hears it
+    struct Gang gang;
+    sample_t gang_in[CHOIR_BLOCK * GANG_LANES];
+    sample_t gang_out[CHOIR_BLOCK * GANG_LANES];
+};
+
+// some voices to run together
+// more than one means theyre interleaved in a gang
+struct Job {
+    int nvoices;
+    struct Voice *voices[GANG_LANES];
+};
+
+struct Choir {
+    int nvoices;
+    int limit; // new notes only get the first this many voices (see limit_choir())
+    struct Voice *voices;
+    long release_frames; // VOICE_RELEASE in samples
+    unsigned long clock; // counts notes so voices know how old they are
+
+    // voices of the same length run GANG_LANES at a time
+    int interleave; // 0 = always run voices one by one
+
+    // 1 = every voice sings its note with the built in glottal source
+    // (on top of whatever comes in, see use_glottis())
+    int glottis;
+
+    // the jobs for the current block
+    struct Job jobs[MAX_VOICES];
+    int njobs;
+    const sample_t *job_in; // the source for the block
+    int job_frames;
+
+    // other threads to spread the jobs across (see start_choir_threads())
+    int threaded;
+    struct Pool pool;
+    int nworkspaces; // 1 for the calling thread and 1 for every worker
+    struct Workspace *workspaces;
+
+    // the tracts can run at a different rate to everything else (see resample_choir())
+    int resampling;
+    struct Resampler to_inside, to_outside;
+    sample_t *inside_in, *inside_out; // CHOIR_BLOCK outside frames worth at the inside rate
+    sample_t *pending; // resampled output that hasnt been asked for yet
+    int npending;
+
+    // a voice thats already settled into every phoneme in the map, silent,
+    // so starting a note is just a copy (see prewarm_choir())
+    struct TractSnapshot *warm;
+    int nwarm;
+};
+
+// build a choir of nvoices tracts at the given sample rate and length in cm
+// a choir of 1 is the classic nancealoid, always singing whatever comes in
+void init_choir(struct Choir *choir, int nvoices, int sample_rate, double length);
+
+// the same but none of the voices print or log anything (for building lots of them at once)
+void init_quiet_choir(struct Choir *choir, int nvoices, int sample_rate, double length);
+
+// spread the voices across nthreads more threads (realtime at priority if > 0)
+// call before running the choir, returns 0 on success
+// the choir still adds the voices up in the same order so the output doesnt change
+int start_choir_threads(struct Choir *choir, int nthreads, int priority);
+
+// give every voice its own glottal source playing the pitch of its note
+// even a choir of 1 only sings while a note is held then
+void use_glottis(struct Choir *choir);
+
+// run the choir at the rate it was built at, but talk to the outside at outside_rate
+// (the source comes in and the voices go out through polyphase resamplers,
+// so the cost of the tracts doesnt depend on the outside rate)
+// does nothing if the rates are the same, returns 0 on success
+int resample_choir(struct Choir *choir, int outside_rate);
+
+void free_choir(struct Choir *choir);
+
+// seed every voices frication noise (each voice gets its own stream)
+void seed_choir(struct Choir *choir, uint32_t seed);
+
+// settle the first voice into every phoneme in the map at the length the voices are now
+// and keep a copy of each (then put it back the way it was)
+// so every note starts right in its shape instead of crossfading there from wherever its voice was
+// init_choir() does it, and any that go stale (the number of segments or the velum changed) get redone on the next note
+void prewarm_choir(struct Choir *choir);
+
+// jump every voice straight to the shape its heading for (see snap_shape())
+void snap_choir(struct Choir *choir);
+
+// how many samples every voice goes between shape updates (see set_control_period())
+void set_choir_control_period(struct Choir *choir, int period);
+
+// count how long every voice spends on shape updates (see time_tract())
+void time_choir(struct Choir *choir, int on);
+
+// how long all the voices spent on shape updates since the last time it was asked (in ns)
+// added up across threads, so with start_choir_threads() it can be more than the time it took
+uint64_t take_choir_shape_ns(struct Choir *choir);
+
+// only give new notes the first nvoices voices (at least 1) and let go of any notes past them
+// (they ring out like a note off, fine on the audio thread)
+void limit_choir(struct Choir *choir, int nvoices);
+
+// apply a single raw midi message to the choir
+void choir_midi(struct Choir *choir, const uint8_t *buffer, size_t size);
+
+// apply a single control event to every voice
+void choir_control(struct Choir *choir, const struct ControlEvent *event);
+
+// run every sounding voice for a block of samples and mix them into out
+// every voice hears the same glottal source
+void run_choir(struct Choir *choir, const sample_t *in, sample_t *out, int nframes);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * nancealoid-watch
+ *
+ * the simplest visualizer there could be lol
+ * reads the tract view a running nancealoid (started with -X) keeps in shared memory
+ * and draws the shape and where the waves are as a couple of lines of text
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "view.h"
+
+// how often to redraw (hz)
+#define WATCH_RATE 20
+
+// darker = more
+static const char levels[] = " .:-=+*#%@";
+#define NLEVELS (sizeof(levels) - 1)
+
+void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-r hz] [-1] <name>\n"
+        "\n"
+        "  <name>  the -X name nancealoid was started with\n"
+        "  -r hz   how often to redraw (default %i)\n"
+        "  -1      print it once and quit\n"
+        "\n"
+        "the glottis is on the left and the lips on the right\n", name, WATCH_RATE);
+    exit(1);
+}
+
+// a row of one character per segment, scaled to the biggest one
+static void draw_row(const char *label, const float *values, int n) {
+    float most = 0;
+    for(int i = 0; i < n; i++)
+        if(values[i] > most)
+            most = values[i];
+    printf("%-8s", label);
+    for(int i = 0; i < n; i++) {
+        int level = most > 0 ? values[i] / most * (NLEVELS - 1) + 0.5 : 0;
+        putchar(levels[level]);
+    }
+    printf("\033[K\n");
+}
+
+static void draw(const struct TractView *view) {
+    printf("%.2fs  %.2fcm  %i segments  velum %.2f  phoneme %.2f %.2f %.2f\033[K\n",
+           (double)view->frame / view->rate, view->tract_length, view->nsegments, view->velum,
+           view->phoneme.tongue_height, view->phoneme.tongue_position, view->phoneme.lips_roundedness);
+    draw_row("area", view->area, view->nsegments);
+    draw_row("energy", view->energy, view->nsegments);
+}
+
+int main(int argc, char **argv) {
+    double hz = WATCH_RATE;
+    int once = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "r:1h")) != -1) {
+        switch(opt) {
+            case 'r': hz = atof(optarg); break;
+            case '1': once = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(argc - optind != 1 || hz <= 0)
+        usage(argv[0]);
+    const char *name = argv[optind];
+
+    struct ViewChannel *channel = share_view_channel(name, 0);
+    if(channel == NULL) {
+        fprintf(stderr, "couldnt open tract view %s (is nancealoid running with -X %s?)\n", name, name);
+        exit(1);
+    }
+
+    long ns = 1e9 / hz;
+    struct timespec interval = { ns / 1000000000, ns % 1000000000 };
+    struct TractView view;
+    int drawn = 0;
+    for(;;) {
+        if(read_view(channel, &view) == 0) {
+            // back up over the last one
+            if(drawn)
+                printf("\033[3A");
+            draw(&view);
+            fflush(stdout);
+            drawn = 1;
+            if(once)
+                break;
+        }
+        nanosleep(&interval, NULL);
+    }
+
+    unshare_view_channel(channel, name, 0);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * tiny wav file reading and writing
+ *
+ * reads 8/16/24/32 bit pcm and 32/64 bit float (any number of channels)
+ * writes 32 bit float mono
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "wav.h"
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xfffe
+
+// how many frames to convert at a time when reading
+#define WAV_READ_CHUNK 1024
+
+// little endian helpers
+static uint32_t get_u32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+static void put_u32(uint8_t *b, uint32_t v) {
+    b[0] = v; b[1] = v >> 8; b[2] = v >> 16; b[3] = v >> 24;
+}
+
+static void put_u16(uint8_t *b, uint16_t v) {
+    b[0] = v; b[1] = v >> 8;
+}
+
+// decode one sample of whatever format the file is in to -1..1
+static double decode_sample(const struct Wav *wav, const uint8_t *b) {
+    if(wav->is_float) {
+        if(wav->bits == 32) {
+            float f;
+            uint32_t u = get_u32(b);
+            memcpy(&f, &u, sizeof(f));
+            return f;
+        } else {
+            double d;
+            uint64_t u = get_u32(b) | ((uint64_t)get_u32(b + 4) << 32);
+            memcpy(&d, &u, sizeof(d));
+            return d;
+        }
+    }
+    switch(wav->bits) {
+        case 8: return (b[0] - 128) / 128.0;
+        case 16: return (int16_t)get_u16(b) / 32768.0;
+        case 24: return ((int32_t)((b[0] << 8) | (b[1] << 16) | ((uint32_t)b[2] << 24)) >> 8) / 8388608.0;
+        default: return (int32_t)get_u32(b) / 2147483648.0;
+    }
+}
+
+int wav_open_read(struct Wav *wav, FILE *file) {
+    uint8_t header[12];
+    uint8_t chunk[8];
+    uint8_t fmt[40];
+    int have_fmt = 0;
+
+    memset(wav, 0, sizeof(*wav));
+    wav->file = file;
+
+    if(fread(header, 1, 12, file) != 12)
+        return -1;
+    if(memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+        return -1;
+
+    // walk the chunks until we find the data
+    while(fread(chunk, 1, 8, file) == 8) {
+        uint32_t size = get_u32(chunk + 4);
+        if(!memcmp(chunk, "fmt ", 4)) {
+            if(size < 16)
+                return -1;
+            uint32_t n = size < sizeof(fmt) ? size : sizeof(fmt);
+            if(fread(fmt, 1, n, file) != n)
+                return -1;
+            // skip whatever we didnt read plus the pad byte
+            for(uint32_t i = n; i < size + (size & 1); i++)
+                fgetc(file);
+
+            int format = get_u16(fmt);
+            if(format == WAV_FORMAT_EXTENSIBLE && n >= 26)
+                format = get_u16(fmt + 24);
+            wav->channels = get_u16(fmt + 2);
+            wav->rate = get_u32(fmt + 4);
+            wav->bits = get_u16(fmt + 14);
+            wav->is_float = format == WAV_FORMAT_FLOAT;
+
+            if(format != WAV_FORMAT_PCM && format != WAV_FORMAT_FLOAT)
+                return -1;
+            if(wav->is_float && wav->bits != 32 && wav->bits != 64)
+                return -1;
+            if(!wav->is_float && wav->bits != 8 && wav->bits != 16 && wav->bits != 24 && wav->bits != 32)
+                return -1;
+            if(wav->channels < 1)
+                return -1;
+            have_fmt = 1;
+        } else if(!memcmp(chunk, "data", 4)) {
+            if(!have_fmt)
+                return -1;
+            wav->frames = size / (wav->channels * (wav->bits / 8));
+            wav->remaining = wav->frames;
+            wav->data_offset = ftell(file);
+            return 0;
+        } else {
+            // not interested
+            for(uint32_t i = 0; i < size + (size & 1); i++)
+                if(fgetc(file) == EOF)
+                    return -1;
+        }
+    }
+    return -1;
+}
+
+size_t wav_read(struct Wav *wav, sample_t *out, size_t nframes) {
+    uint8_t raw[WAV_READ_CHUNK * 8 * 2];
+    size_t bytes = wav->bits / 8;
+    size_t frame_bytes = bytes * wav->channels;
+    size_t max_chunk = sizeof(raw) / frame_bytes;
+    size_t done = 0;
+
+    if(max_chunk == 0)
+        return 0;
+    if(nframes > wav->remaining)
+        nframes = wav->remaining;
+
+    while(done < nframes) {
+        size_t want = nframes - done;
+        if(want > max_chunk)
+            want = max_chunk;
+        size_t got = fread(raw, frame_bytes, want, wav->file);
+        for(size_t i = 0; i < got; i++) {
+            // mix all the channels down to mono
+            double sum = 0;
+            for(int c = 0; c < wav->channels; c++)
+                sum += decode_sample(wav, raw + i * frame_bytes + c * bytes);
+            out[done + i] = sum / wav->channels;
+        }
+        done += got;
+        wav->remaining -= got;
+        if(got < want)
+            break;
+    }
+    return done;
+}
+
+// fill in a header for a float mono file of the given length
+static void make_header(uint8_t *h, int rate, size_t frames) {
+    // rather than wrapping round to some short length
+    if(frames > WAV_MAX_FRAMES)
+        frames = WAV_MAX_FRAMES;
+    uint32_t data_size = frames * sizeof(float);
+    memcpy(h, "RIFF", 4);
+    put_u32(h + 4, 36 + data_size);
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    put_u32(h + 16, 16);
+    put_u16(h + 20, WAV_FORMAT_FLOAT);
+    put_u16(h + 22, 1);
+    put_u32(h + 24, rate);
+    put_u32(h + 28, rate * sizeof(float));
+    put_u16(h + 32, sizeof(float));
+    put_u16(h + 34, 32);
+    memcpy(h + 36, "data", 4);
+    put_u32(h + 40, data_size);
+}
+
+int wav_open_write(struct Wav *wav, FILE *file, int rate) {
+    uint8_t header[44];
+
+    memset(wav, 0, sizeof(*wav));
+    wav->file = file;
+    wav->rate = rate;
+    wav->channels = 1;
+    wav->bits = 32;
+    wav->is_float = 1;
+
+    // sizes get patched in when the file is closed
+    // if the output cant seek (a pipe) readers will have to cope with the max size
+    make_header(header, rate, WAV_MAX_FRAMES);
+    if(fwrite(header, 1, sizeof(header), file) != sizeof(header))
+        return -1;
+    wav->data_offset = sizeof(header);
+    return 0;
+}
+
+size_t wav_write(struct Wav *wav, const sample_t *in, size_t nframes) {
+    uint8_t raw[WAV_READ_CHUNK * sizeof(float)];
+    size_t done = 0;
+
+    while(done < nframes) {
+        size_t n = nframes - done;
+        if(n > WAV_READ_CHUNK)
+            n = WAV_READ_CHUNK;
+        for(size_t i = 0; i < n; i++) {
+            float f = in[done + i];
+            uint32_t u;
+            memcpy(&u, &f, sizeof(u));
+            put_u32(raw + i * sizeof(float), u);
+        }
+        size_t got = fwrite(raw, sizeof(float), n, wav->file);
+        done += got;
+        wav->frames += got;
+        if(got < n)
+            break;
+    }
+    return done;
+}
+
+int wav_seek(struct Wav *wav, size_t frame) {
+    long frame_bytes = wav->channels * (wav->bits / 8);
+    if(wav->data_offset < 0 || fseek(wav->file, wav->data_offset + (long)frame * frame_bytes, SEEK_SET))
+        return -1;
+    wav->remaining = frame < wav->frames ? wav->frames - frame : 0;
+    return 0;
+}
+
+int wav_close_write(struct Wav *wav) {
+    uint8_t header[44];
+
+    make_header(header, wav->rate, wav->frames);
+    if(fseek(wav->file, 0, SEEK_SET))
+        return -1;
+    if(fwrite(header, 1, sizeof(header), wav->file) != sizeof(header))
+        return -1;
+    return fseek(wav->file, 0, SEEK_END);
+}
@@ -0,0 +1,51 @@
+/*
+ * tiny wav file reading and writing
+ * just enough for feeding the tract offline and writing out what it says
+ */
+
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdio.h>
+#include "tract.h"
+
+// the most frames the 32 bit sizes in a header can count (about 6 hours at 48khz)
+#define WAV_MAX_FRAMES ((0xffffffff - 36) / sizeof(float))
+
+struct Wav {
+    FILE *file;
+    int rate; // sample rate
+    int channels;
+    int bits; // bits per sample
+    int is_float; // 1 = ieee float samples, 0 = integer pcm
+    size_t frames; // frames in the file (reading) or written so far (writing)
+    size_t remaining; // frames left to read
+    long data_offset; // where the samples start in the file
+};
+
+// read the header of a wav file and get ready to read samples
+// returns 0 on success
+int wav_open_read(struct Wav *wav, FILE *file);
+
+// read up to nframes frames, mixed down to mono
+// returns how many frames were actually read
+size_t wav_read(struct Wav *wav, sample_t *out, size_t nframes);
+
+// start writing a 32 bit float mono wav file
+// returns 0 on success
+int wav_open_write(struct Wav *wav, FILE *file, int rate);
+
+// write some mono frames
+// returns how many frames were actually written
+size_t wav_write(struct Wav *wav, const sample_t *in, size_t nframes);
+
+// move to a particular frame for reading or writing (if the file can seek)
+// returns 0 on success
+int wav_seek(struct Wav *wav, size_t frame);
+
+// go back and fill in the sizes in the header (if the file can seek)
+// (anything past WAV_MAX_FRAMES is still in the file but the header stops counting there)
+// returns 0 on success
+int wav_close_write(struct Wav *wav);
+
+#endif